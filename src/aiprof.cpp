@@ -0,0 +1,133 @@
+#include "./aiprof.h"
+
+#include <cstring>
+#include <fstream>
+
+using namespace std;
+
+thread_local AIProfile *ai_prof = NULL;
+
+static const char *phase_names[AI_PROF_NUM_PHASES] = {
+    "analyze",
+    "expand",
+    "harvesters",
+    "armories",
+    "attack",
+    "transport",
+    "search",
+};
+
+static const char *counter_names[AI_PROF_NUM_COUNTERS] = {
+    "bfs_calls",
+    "bfs_nodes",
+    "pathfind_calls",
+    "pathfind_nodes",
+    "map_clones",
+    "allocations",
+    "book_hits",
+    "mcts_playouts",
+    "tt_probes",
+    "tt_hits",
+};
+
+const char *ai_prof_phase_name(int phase) {
+    return phase_names[phase];
+}
+
+const char *ai_prof_counter_name(int counter) {
+    return counter_names[counter];
+}
+
+AIProfile::AIProfile() {
+    reset();
+}
+
+void AIProfile::reset(void) {
+    for(int i = 0; i < AI_PROF_NUM_PHASES; i++) {
+        m_phase_ns[i].store(0, memory_order_relaxed);
+        m_phase_calls[i].store(0, memory_order_relaxed);
+    }
+    for(int i = 0; i < AI_PROF_NUM_COUNTERS; i++) {
+        m_counters[i].store(0, memory_order_relaxed);
+    }
+}
+
+void AIProfile::add_time(int phase, double seconds) {
+    m_phase_ns[phase].fetch_add((int64_t)(seconds * 1e9), memory_order_relaxed);
+    m_phase_calls[phase].fetch_add(1, memory_order_relaxed);
+}
+
+AITurnProfile AIProfile::result(int turn, int side, int actions, double time) const {
+    AITurnProfile p;
+    p.m_turn = turn;
+    p.m_side = side;
+    p.m_actions = actions;
+    p.m_time = time;
+    for(int i = 0; i < AI_PROF_NUM_PHASES; i++) {
+        p.m_phase_time[i] = m_phase_ns[i].load(memory_order_relaxed) / 1e9;
+        p.m_phase_calls[i] = m_phase_calls[i].load(memory_order_relaxed);
+    }
+    for(int i = 0; i < AI_PROF_NUM_COUNTERS; i++) {
+        p.m_counters[i] = m_counters[i].load(memory_order_relaxed);
+    }
+    return p;
+}
+
+void ai_prof_write_json(ostream& os, const AITurnProfile& p) {
+    os << "{\"turn\":" << p.m_turn
+       << ",\"side\":" << p.m_side
+       << ",\"actions\":" << p.m_actions
+       << ",\"time\":" << p.m_time
+       << ",\"phases\":{";
+    for(int i = 0; i < AI_PROF_NUM_PHASES; i++) {
+        os << (i ? "," : "") << "\"" << phase_names[i] << "\":{\"time\":"
+           << p.m_phase_time[i] << ",\"calls\":" << p.m_phase_calls[i] << "}";
+    }
+    os << "},\"counters\":{";
+    for(int i = 0; i < AI_PROF_NUM_COUNTERS; i++) {
+        os << (i ? "," : "") << "\"" << counter_names[i] << "\":" << p.m_counters[i];
+    }
+    os << "}}\n";
+}
+
+void ai_prof_write_csv_header(ostream& os) {
+    os << "turn,side,actions,time";
+    for(int i = 0; i < AI_PROF_NUM_PHASES; i++) {
+        os << "," << phase_names[i] << "_time," << phase_names[i] << "_calls";
+    }
+    for(int i = 0; i < AI_PROF_NUM_COUNTERS; i++) {
+        os << "," << counter_names[i];
+    }
+    os << "\n";
+}
+
+void ai_prof_write_csv(ostream& os, const AITurnProfile& p) {
+    os << p.m_turn << "," << p.m_side << "," << p.m_actions << "," << p.m_time;
+    for(int i = 0; i < AI_PROF_NUM_PHASES; i++) {
+        os << "," << p.m_phase_time[i] << "," << p.m_phase_calls[i];
+    }
+    for(int i = 0; i < AI_PROF_NUM_COUNTERS; i++) {
+        os << "," << p.m_counters[i];
+    }
+    os << "\n";
+}
+
+void ai_prof_append(const char *filename, const AITurnProfile& p) {
+    const size_t len = strlen(filename);
+    const bool csv = len >= 4 and strcmp(filename + len - 4, ".csv") == 0;
+
+    // a new csv file starts with the header
+    bool empty;
+    {
+        ifstream in(filename);
+        empty = in.peek() == ifstream::traits_type::eof();
+    }
+
+    ofstream os(filename, ios::app);
+    if(csv == true) {
+        if(empty == true) ai_prof_write_csv_header(os);
+        ai_prof_write_csv(os, p);
+    } else {
+        ai_prof_write_json(os, p);
+    }
+}
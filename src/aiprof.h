@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+enum AIProfPhase {
+    AI_PROF_ANALYZE,
+    AI_PROF_EXPAND,
+    AI_PROF_HARVESTERS,
+    AI_PROF_ARMORIES,
+    AI_PROF_ATTACK,
+    AI_PROF_TRANSPORT,
+    AI_PROF_SEARCH,
+    AI_PROF_NUM_PHASES,
+};
+
+enum AIProfCounter {
+    AI_PROF_BFS_CALLS,
+    AI_PROF_BFS_NODES,
+    AI_PROF_PATHFIND_CALLS,
+    AI_PROF_PATHFIND_NODES,
+    AI_PROF_MAP_CLONES,
+    AI_PROF_ALLOCATIONS,
+    AI_PROF_BOOK_HITS,
+    AI_PROF_MCTS_PLAYOUTS,
+    AI_PROF_TT_PROBES,
+    AI_PROF_TT_HITS,
+    AI_PROF_NUM_COUNTERS,
+};
+
+const char *ai_prof_phase_name(int phase);
+const char *ai_prof_counter_name(int counter);
+
+// what one AI turn spent
+struct AITurnProfile {
+    int m_turn;
+    int m_side;
+    int m_actions;
+    double m_time;
+    double m_phase_time[AI_PROF_NUM_PHASES];
+    long m_phase_calls[AI_PROF_NUM_PHASES];
+    long m_counters[AI_PROF_NUM_COUNTERS];
+};
+
+/*
+  Collects the time and counts of one AI turn. Everything is atomic so
+  the island workers can report to the same profile. The phase times
+  from the workers are added up, so together they can be more than the
+  wall time of the turn.
+ */
+struct AIProfile {
+    AIProfile();
+
+    void reset(void);
+    void add_time(int phase, double seconds);
+    void count(int counter, long n = 1) {
+        m_counters[counter].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    AITurnProfile result(int turn, int side, int actions, double time) const;
+
+private:
+    std::atomic<int64_t> m_phase_ns[AI_PROF_NUM_PHASES];
+    std::atomic<long> m_phase_calls[AI_PROF_NUM_PHASES];
+    std::atomic<long> m_counters[AI_PROF_NUM_COUNTERS];
+};
+
+// the profile the AI running on this thread reports to, or NULL
+extern thread_local AIProfile *ai_prof;
+
+static inline void ai_prof_count(int counter, long n = 1) {
+    if(ai_prof != NULL) ai_prof->count(counter, n);
+}
+
+// makes p this thread's profile while in scope
+struct AIProfBind {
+    explicit AIProfBind(AIProfile *p) : m_old(ai_prof) { ai_prof = p; }
+    ~AIProfBind() { ai_prof = m_old; }
+private:
+    AIProfile *m_old;
+};
+
+// adds the time until the end of the scope to phase
+struct AIProfTimer {
+    explicit AIProfTimer(int phase)
+        : m_prof(ai_prof), m_phase(phase), m_start(std::chrono::steady_clock::now()) { }
+    ~AIProfTimer() {
+        if(m_prof == NULL) return;
+        std::chrono::duration<double> d = std::chrono::steady_clock::now() - m_start;
+        m_prof->add_time(m_phase, d.count());
+    }
+private:
+    AIProfile *m_prof;
+    int m_phase;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+// one JSON object per line
+void ai_prof_write_json(std::ostream& os, const AITurnProfile& p);
+void ai_prof_write_csv_header(std::ostream& os);
+void ai_prof_write_csv(std::ostream& os, const AITurnProfile& p);
+
+// appends p to filename, as CSV if it ends in .csv and JSON otherwise
+void ai_prof_append(const char *filename, const AITurnProfile& p);
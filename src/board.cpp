@@ -0,0 +1,451 @@
+#include "./board.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+using namespace std;
+
+// units moved per action, same as HexMap::m_max_units_moved
+static const int max_units_moved = 8;
+// how far units can walk through their own territory
+static const int move_range = 4;
+
+BoardTopology::BoardTopology() {
+    m_size = 0;
+    m_neighbor_start.push_back(0);
+    m_cannon_start.push_back(0);
+}
+
+void BoardTopology::add_hex(const vector<int>& neighbors,
+                            const vector<int>& cannon_targets) {
+    m_neighbors.insert(m_neighbors.end(), neighbors.begin(), neighbors.end());
+    m_neighbor_start.push_back(m_neighbors.size());
+    m_cannon_targets.insert(m_cannon_targets.end(),
+                            cannon_targets.begin(), cannon_targets.end());
+    m_cannon_start.push_back(m_cannon_targets.size());
+    m_size++;
+}
+
+Board::Board(const BoardTopology *topo) {
+    m_topo = topo;
+    m_cells.resize(topo->m_size);
+    m_resources[0] = m_resources[1] = 0;
+    m_carriers[0] = m_carriers[1] = 0;
+    m_turn = Side::Red;
+
+    m_dist.assign(topo->m_size, -1);
+    m_queue.reserve(topo->m_size);
+    m_reach.reserve(topo->m_size);
+}
+
+void Board::copy_from(const Board& o) {
+    assert(o.m_topo == m_topo);
+    // same size, so this doesn't reallocate
+    m_cells = o.m_cells;
+    m_resources[0] = o.m_resources[0];
+    m_resources[1] = o.m_resources[1];
+    m_carriers[0] = o.m_carriers[0];
+    m_carriers[1] = o.m_carriers[1];
+    m_turn = o.m_turn;
+}
+
+// same as HexMap::BFS(base, range): hexes connected to from through its
+// side's hexes, plus the direct neighbors of from. Result in m_reach
+int Board::reachable(int from, int range) {
+    const uint8_t side = m_cells[from].side;
+
+    m_queue.clear();
+    m_reach.clear();
+
+    m_dist[from] = 0;
+    m_queue.push_back(from);
+    m_reach.push_back(from);
+
+    for(size_t qi = 0; qi < m_queue.size(); qi++) {
+        int cur = m_queue[qi];
+        for(const int *n = m_topo->neighbors_begin(cur); n != m_topo->neighbors_end(cur); ++n) {
+            const Cell& c = m_cells[*n];
+            bool ok_side = c.side == side || cur == from;
+
+            if(c.alive() && m_dist[*n] == -1 && ok_side) {
+                m_dist[*n] = m_dist[cur] + 1;
+                m_reach.push_back(*n);
+                if(c.side == side && m_dist[*n] <= range)
+                    m_queue.push_back(*n);
+            }
+        }
+    }
+
+    // reset the scratch and keep the ones in range
+    size_t j = 0;
+    for(size_t i = 0; i < m_reach.size(); i++) {
+        int h = m_reach[i];
+        if(m_dist[h] <= range)
+            m_reach[j++] = h;
+        m_dist[h] = -1;
+    }
+    m_reach.resize(j);
+    return j;
+}
+
+bool Board::free_move(int from, int to) {
+    reachable(from, move_range);
+    return find(m_reach.begin(), m_reach.end(), to) != m_reach.end();
+}
+
+bool Board::is_legal(const Move& m) {
+    const uint8_t me = (uint8_t)m_turn;
+    const int t = turn_index();
+
+    if(m.m_act == MapAction::EndTurn)
+        return true;
+    if(m.m_act == MapAction::BuildCarrier)
+        return m_resources[t] >= carrier_cost;
+
+    if(m.m_src < 0 || m.m_src >= size())
+        return false;
+    const Cell& src = m_cells[m.m_src];
+    if(src.alive() == false || src.side != me)
+        return false;
+
+    switch(m.m_act) {
+    case MapAction::MovingUnits: {
+        if(m.m_dst < 0 || m.m_dst >= size() || m.m_dst == m.m_src)
+            return false;
+        if(m.m_amount < 1 || src.units_free < 1 || m_cells[m.m_dst].alive() == false)
+            return false;
+        return m_carriers[t] >= 1 || free_move(m.m_src, m.m_dst);
+    }
+    case MapAction::BuildHarvester:
+        return src.has(CELL_HARVESTER) == false && m_resources[t] >= harvester_cost;
+    case MapAction::DestroyHarvester:
+        return src.has(CELL_HARVESTER);
+    case MapAction::AddAmmoToCannon:
+        return src.has(CELL_CANNON) && src.has(CELL_AMMO | CELL_LOADED_AMMO) == false
+            && m_resources[t] >= cannon_ammo_cost;
+    case MapAction::BuildCannon:
+        return src.has(CELL_CANNON) == false && m_resources[t] >= cannon_cost;
+    case MapAction::BuildArmory:
+        return src.has(CELL_ARMORY) == false && m_resources[t] >= armory_cost;
+    case MapAction::BuildWalker:
+        return src.has(CELL_ARMORY) && m.m_amount >= 1
+            && m_resources[t] >= walker_cost * m.m_amount;
+    case MapAction::FireCannon: {
+        if(src.has(CELL_CANNON) == false || src.has(CELL_AMMO) == false)
+            return false;
+        const int *b = m_topo->cannon_begin(m.m_src);
+        const int *e = m_topo->cannon_end(m.m_src);
+        return find(b, e, m.m_dst) != e && m_cells[m.m_dst].alive();
+    }
+    default:
+        return false;
+    }
+}
+
+/*
+  Writes up to cap legal moves for the side to move into buf and returns
+  how many were written. Moves either take one unit or as many as
+  possible; recruiting is one walker at a time. Cannons are only fired
+  at the other sides.
+
+  actions is a set of action_mask() bits, plus carrier_moves_mask for
+  moves that need a carrier. With src >= 0 only moves from that hex are
+  generated.
+ */
+int Board::gen_moves(Move *buf, int cap, unsigned actions, int src) {
+    int n = 0;
+    const uint8_t me = (uint8_t)m_turn;
+    const int t = turn_index();
+    const int res = m_resources[t];
+    const int first = src >= 0 ? src : 0;
+    const int last = src >= 0 ? src + 1 : size();
+    const bool moves = (actions & action_mask(MapAction::MovingUnits)) != 0;
+
+#define EMIT(act, src, dst, amount) do {                                \
+        if(n >= cap) return n;                                          \
+        buf[n].m_act = act; buf[n].m_src = src;                         \
+        buf[n].m_dst = dst; buf[n].m_amount = amount; n++;              \
+    } while(0)
+
+#define WANT(act) ((actions & action_mask(act)) != 0)
+
+    if(WANT(MapAction::EndTurn))
+        EMIT(MapAction::EndTurn, -1, -1, 0);
+
+    if(WANT(MapAction::BuildCarrier) && src < 0 && res >= carrier_cost)
+        EMIT(MapAction::BuildCarrier, -1, -1, 1);
+
+    for(int i = first; i < last; i++) {
+        const Cell& c = m_cells[i];
+        if(c.alive() == false || c.side != me)
+            continue;
+
+        if(WANT(MapAction::FireCannon) && c.has(CELL_CANNON) && c.has(CELL_AMMO)) {
+            for(const int *d = m_topo->cannon_begin(i); d != m_topo->cannon_end(i); ++d) {
+                const Cell& target = m_cells[*d];
+                if(target.alive() && target.side != me)
+                    EMIT(MapAction::FireCannon, i, *d, 1);
+            }
+        }
+
+        if(WANT(MapAction::BuildWalker) && c.has(CELL_ARMORY) && res >= walker_cost)
+            EMIT(MapAction::BuildWalker, i, -1, 1);
+
+        if(moves && c.units_free > 0) {
+            int most = min((int)c.units_free, max_units_moved);
+            reachable(i, move_range);
+            for(size_t k = 0; k < m_reach.size(); k++) {
+                int d = m_reach[k];
+                if(d == i)
+                    continue;
+                EMIT(MapAction::MovingUnits, i, d, 1);
+                if(most > 1)
+                    EMIT(MapAction::MovingUnits, i, d, most);
+            }
+        }
+    }
+
+    for(int i = first; i < last; i++) {
+        const Cell& c = m_cells[i];
+        if(c.alive() == false || c.side != me)
+            continue;
+
+        if(WANT(MapAction::BuildHarvester) && c.has(CELL_HARVESTER) == false &&
+           res >= harvester_cost)
+            EMIT(MapAction::BuildHarvester, i, -1, 0);
+        if(WANT(MapAction::BuildArmory) && c.has(CELL_ARMORY) == false && res >= armory_cost)
+            EMIT(MapAction::BuildArmory, i, -1, 0);
+        if(WANT(MapAction::BuildCannon) && c.has(CELL_CANNON) == false && res >= cannon_cost)
+            EMIT(MapAction::BuildCannon, i, -1, 0);
+        if(WANT(MapAction::AddAmmoToCannon) && c.has(CELL_CANNON) &&
+           c.has(CELL_AMMO | CELL_LOADED_AMMO) == false && res >= cannon_ammo_cost)
+            EMIT(MapAction::AddAmmoToCannon, i, -1, 0);
+        if(WANT(MapAction::DestroyHarvester) && c.has(CELL_HARVESTER))
+            EMIT(MapAction::DestroyHarvester, i, -1, 0);
+    }
+
+    // carriers can take units anywhere
+    if(moves && (actions & carrier_moves_mask) != 0 && m_carriers[t] >= 1) {
+        for(int i = first; i < last; i++) {
+            const Cell& c = m_cells[i];
+            if(c.alive() == false || c.side != me || c.units_free == 0)
+                continue;
+            int most = min((int)c.units_free, max_units_moved);
+            // mark the free moves so they're skipped
+            reachable(i, move_range);
+            for(auto&& r : m_reach) m_dist[r] = 0;
+            for(int d = 0; d < size() && n < cap; d++) {
+                if(m_cells[d].alive() == false || m_dist[d] == 0)
+                    continue;
+                buf[n].m_act = MapAction::MovingUnits;
+                buf[n].m_src = i;
+                buf[n].m_dst = d;
+                buf[n].m_amount = most;
+                n++;
+            }
+            for(auto&& r : m_reach) m_dist[r] = -1;
+        }
+    }
+#undef WANT
+#undef EMIT
+
+    return n;
+}
+
+void Board::harvest_cell(int i) {
+    assert(m_cells[i].level > 0);
+    m_cells[i].level -= 1;
+    m_cells[i].flags |= CELL_HARVESTED;
+}
+
+// HexMap::move_or_attack
+void Board::move_or_attack(int from, int to, int amount) {
+    Cell& a = m_cells[from];
+    Cell& d = m_cells[to];
+
+    int moved = min({ amount, (int)a.units_free, max_units_moved });
+    assert(moved > 0);
+
+    if(d.side == (uint8_t)Side::Neutral || d.side == a.side) {
+        d.units_moved += moved;
+        d.side = a.side;
+        a.units_free -= moved;
+    }
+    else if(moved >= d.units_free + d.units_moved) {
+        d.units_moved = moved - (d.units_free + d.units_moved);
+        d.side = a.side;
+        d.units_free = 0;
+        a.units_free -= moved;
+    }
+    else {
+        a.units_free -= moved;
+        if(moved < d.units_free) {
+            d.units_free -= moved;
+        } else {
+            d.units_moved -= (moved - d.units_free);
+            d.units_free = 0;
+        }
+    }
+}
+
+void Board::apply(const Move& m) {
+    const int t = turn_index();
+
+    switch(m.m_act) {
+    case MapAction::MovingUnits:
+        if(free_move(m.m_src, m.m_dst) == false) {
+            assert(m_carriers[t] >= 1);
+            m_carriers[t] -= 1;
+        }
+        move_or_attack(m.m_src, m.m_dst, m.m_amount);
+        break;
+    case MapAction::BuildHarvester:
+        m_cells[m.m_src].flags |= CELL_HARVESTER;
+        m_resources[t] -= harvester_cost;
+        break;
+    case MapAction::DestroyHarvester:
+        for(const int *n = m_topo->neighbors_begin(m.m_src); n != m_topo->neighbors_end(m.m_src); ++n) {
+            if(m_cells[*n].alive())
+                harvest_cell(*n);
+        }
+        harvest_cell(m.m_src);
+        m_cells[m.m_src].flags &= ~CELL_HARVESTER;
+        break;
+    case MapAction::AddAmmoToCannon:
+        m_cells[m.m_src].flags |= CELL_LOADED_AMMO;
+        m_resources[t] -= cannon_ammo_cost;
+        break;
+    case MapAction::BuildCannon:
+        m_cells[m.m_src].flags |= CELL_CANNON;
+        m_resources[t] -= cannon_cost;
+        break;
+    case MapAction::FireCannon: {
+        m_cells[m.m_src].flags &= ~CELL_AMMO;
+        Cell& d = m_cells[m.m_dst];
+        d.level -= 1;
+        // Hex::destroy_units(8)
+        int rest = d.units_free - 8;
+        d.units_free -= min((int)d.units_free, 8);
+        if(rest < 0)
+            d.units_moved = max(0, d.units_moved + rest);
+        break;
+    }
+    case MapAction::BuildWalker:
+        m_cells[m.m_src].units_moved += m.m_amount;
+        m_resources[t] -= walker_cost * m.m_amount;
+        break;
+    case MapAction::BuildArmory:
+        m_cells[m.m_src].flags |= CELL_ARMORY;
+        m_resources[t] -= armory_cost;
+        break;
+    case MapAction::BuildCarrier:
+        m_carriers[t] += 1;
+        m_resources[t] -= carrier_cost;
+        break;
+    case MapAction::EndTurn:
+        end_turn();
+        break;
+    }
+    assert(m_resources[t] >= 0);
+}
+
+// HexMap::harvest, the turn income and HexMap::free_units for the side
+// to move
+void Board::begin_turn(void) {
+    const uint8_t me = (uint8_t)m_turn;
+    const int t = turn_index();
+
+    for(auto&& c : m_cells)
+        c.flags &= ~CELL_HARVESTED;
+
+    for(int i = 0; i < size(); i++) {
+        if(m_cells[i].alive() == false || m_cells[i].side != me ||
+           m_cells[i].has(CELL_HARVESTER) == false)
+            continue;
+        for(const int *n = m_topo->neighbors_begin(i); n != m_topo->neighbors_end(i); ++n) {
+            if(m_cells[*n].alive() && m_cells[*n].has(CELL_HARVESTED) == false) {
+                harvest_cell(*n);
+                m_resources[t] += 2;
+            }
+        }
+        harvest_cell(i);
+        m_resources[t] += 2;
+    }
+
+    m_resources[t] += 4;
+
+    for(auto&& c : m_cells) {
+        if(c.side != me)
+            continue;
+        c.units_free += c.units_moved;
+        c.units_moved = 0;
+        if(c.has(CELL_LOADED_AMMO))
+            c.flags |= CELL_AMMO;
+        c.flags &= ~CELL_LOADED_AMMO;
+    }
+}
+
+void Board::end_turn(void) {
+    m_turn = other_side();
+    begin_turn();
+}
+
+// same as is_won(): a side without any units has lost
+Side Board::winner(void) const {
+    bool red = false;
+    bool blue = false;
+    for(auto&& c : m_cells) {
+        if(c.alive() && c.units_free + c.units_moved >= 1) {
+            if(c.side == (uint8_t)Side::Red) red = true;
+            else if(c.side == (uint8_t)Side::Blue) blue = true;
+        }
+    }
+    if(red == false) return Side::Blue;
+    if(blue == false) return Side::Red;
+    return Side::Neutral;
+}
+
+float Board::material(Side s) const {
+    float score[2] = { 0, 0 };
+
+    for(auto&& c : m_cells) {
+        if(c.alive() == false || c.side >= 2)
+            continue;
+        float v = c.level
+            + 4 * (c.units_free + c.units_moved)
+            + (c.has(CELL_HARVESTER) ? 10 : 0)
+            + (c.has(CELL_ARMORY) ? 20 : 0)
+            + (c.has(CELL_CANNON) ? 15 : 0)
+            + (c.has(CELL_AMMO | CELL_LOADED_AMMO) ? 5 : 0);
+        score[c.side] += v;
+    }
+    for(int i = 0; i < 2; i++) {
+        score[i] += m_resources[i] / 2.0f + m_carriers[i] * 25;
+    }
+
+    int me = (int)s;
+    return score[me] - score[1 - me];
+}
+
+static inline uint64_t mix(uint64_t h, uint64_t v) {
+    h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    return h;
+}
+
+uint64_t Board::hash(void) const {
+    uint64_t ret = 0xcbf29ce484222325ULL;
+    for(auto&& c : m_cells) {
+        ret = mix(ret, (uint64_t)(uint16_t)c.level
+                  | ((uint64_t)(uint16_t)c.units_free << 16)
+                  | ((uint64_t)(uint16_t)c.units_moved << 32)
+                  | ((uint64_t)c.side << 48)
+                  | ((uint64_t)(c.flags & ~CELL_HARVESTED) << 56));
+    }
+    ret = mix(ret, m_resources[0]);
+    ret = mix(ret, m_resources[1]);
+    ret = mix(ret, m_carriers[0]);
+    ret = mix(ret, m_carriers[1]);
+    ret = mix(ret, (uint64_t)m_turn);
+    return ret;
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "./side.h"
+
+enum class MapAction {
+    MovingUnits,
+    BuildHarvester,
+    DestroyHarvester,
+    AddAmmoToCannon,
+    BuildCannon,
+    FireCannon,
+    BuildWalker,
+    BuildArmory,
+    BuildCarrier,
+    EndTurn,
+};
+
+// prices, shared by the UI and the AI
+const int harvester_cost = 10;
+const int cannon_ammo_cost = 20;
+const int cannon_cost = 30;
+const int armory_cost = 35;
+const int walker_cost = 8;
+const int carrier_cost = 50;
+
+struct Move {
+    MapAction m_act;
+    int m_src;
+    int m_dst;
+    int m_amount;
+};
+
+// filters for Board::gen_moves()
+inline unsigned action_mask(MapAction a) { return 1u << (int)a; }
+// MovingUnits outside of the free move range, which use up a carrier
+const unsigned carrier_moves_mask = 1u << 31;
+const unsigned all_actions_mask = ~0u;
+
+/*
+  The parts of a map that don't change during a game: which hexes
+  neighbor each other and which hexes a cannon on each hex can hit.
+  Built once per map from the HexMap, shared by every Board copy.
+ */
+struct BoardTopology {
+    int m_size;
+    std::vector<int> m_neighbor_start;
+    std::vector<int> m_neighbors;
+    std::vector<int> m_cannon_start;
+    std::vector<int> m_cannon_targets;
+
+    BoardTopology();
+
+    void add_hex(const std::vector<int>& neighbors,
+                 const std::vector<int>& cannon_targets);
+
+    const int *neighbors_begin(int i) const {
+        return m_neighbors.data() + m_neighbor_start[i];
+    }
+    const int *neighbors_end(int i) const {
+        return m_neighbors.data() + m_neighbor_start[i + 1];
+    }
+    const int *cannon_begin(int i) const {
+        return m_cannon_targets.data() + m_cannon_start[i];
+    }
+    const int *cannon_end(int i) const {
+        return m_cannon_targets.data() + m_cannon_start[i + 1];
+    }
+};
+
+enum CellFlags {
+    CELL_HARVESTER   = 1 << 0,
+    CELL_ARMORY      = 1 << 1,
+    CELL_CANNON      = 1 << 2,
+    CELL_AMMO        = 1 << 3,
+    CELL_LOADED_AMMO = 1 << 4,
+    CELL_HARVESTED   = 1 << 5,
+};
+
+struct Cell {
+    int16_t level;
+    int16_t units_free;
+    int16_t units_moved;
+    uint8_t side;
+    uint8_t flags;
+
+    bool alive(void) const { return level > 0; }
+    bool has(int flag) const { return (flags & flag) != 0; }
+};
+
+/*
+  Compact copy of the game state with the same rules as HexMap and
+  MapUI::MapHexSelected, for the AI to search on. Copying and playing
+  on a Board doesn't allocate once it's been constructed.
+
+  Only supports two sides, Red and Blue.
+ */
+struct Board {
+    const BoardTopology *m_topo;
+    std::vector<Cell> m_cells;
+    int m_resources[2];
+    int m_carriers[2];
+    Side m_turn;
+
+    explicit Board(const BoardTopology *topo);
+
+    void copy_from(const Board& o);
+
+    int size(void) const { return m_topo->m_size; }
+    int turn_index(void) const { return (int)m_turn; }
+    Side other_side(void) const {
+        return m_turn == Side::Red ? Side::Blue : Side::Red;
+    }
+
+    bool free_move(int from, int to);
+    bool is_legal(const Move& m);
+    int gen_moves(Move *buf, int cap,
+                  unsigned actions = all_actions_mask, int src = -1);
+
+    void apply(const Move& m);
+    void begin_turn(void);
+    void end_turn(void);
+
+    // the side that won or Side::Neutral
+    Side winner(void) const;
+    // material score of side s minus the other side's
+    float material(Side s) const;
+    uint64_t hash(void) const;
+
+private:
+    // BFS scratch, not part of the state
+    std::vector<int16_t> m_dist;
+    std::vector<int> m_queue;
+    std::vector<int> m_reach;
+
+    int reachable(int from, int range);
+    void harvest_cell(int i);
+    void move_or_attack(int from, int to, int amount);
+};
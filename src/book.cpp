@@ -0,0 +1,103 @@
+#include "./book.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include "./util.h"
+#include "./varint.h"
+
+using namespace std;
+
+static const char magic[4] = { 'A', 'V', 'B', 'K' };
+static const int version = 1;
+
+const OpeningBook::Entry *OpeningBook::find(uint64_t hash) const {
+    auto it = lower_bound(m_entries.begin(), m_entries.end(), hash,
+                          [](const Entry& e, uint64_t h) { return e.m_hash < h; });
+    if(it == m_entries.end() or it->m_hash != hash)
+        return NULL;
+    return &*it;
+}
+
+bool OpeningBook::contains(uint64_t hash) const {
+    return find(hash) != NULL;
+}
+
+bool OpeningBook::lookup(uint64_t hash, vector<Move>& out) const {
+    const Entry *e = find(hash);
+    if(e == NULL)
+        return false;
+    out.assign(m_moves.begin() + e->m_first, m_moves.begin() + e->m_first + e->m_num);
+    return true;
+}
+
+void OpeningBook::add(uint64_t hash, const vector<Move>& moves) {
+    auto it = lower_bound(m_entries.begin(), m_entries.end(), hash,
+                          [](const Entry& e, uint64_t h) { return e.m_hash < h; });
+    if(it == m_entries.end() or it->m_hash != hash)
+        it = m_entries.insert(it, Entry());
+
+    // the old moves stay in m_moves until the book is saved and loaded
+    it->m_hash = hash;
+    it->m_first = m_moves.size();
+    it->m_num = moves.size();
+    m_moves.insert(m_moves.end(), moves.begin(), moves.end());
+}
+
+bool OpeningBook::save(const char *filename) const {
+    vector<uint8_t> out(magic, magic + 4);
+    put_uint(out, version);
+    put_uint(out, m_entries.size());
+    for(auto&& e : m_entries) {
+        for(int i = 0; i < 8; i++) out.push_back((uint8_t)(e.m_hash >> (8 * i)));
+        put_uint(out, e.m_num);
+        for(int i = 0; i < e.m_num; i++) put_move(out, m_moves[e.m_first + i]);
+    }
+
+    ofstream os(filename, ios::out | ios::binary | ios::trunc);
+    os.write((const char *)out.data(), out.size());
+    return os.good();
+}
+
+bool OpeningBook::load(const char *filename) {
+    m_entries.clear();
+    m_moves.clear();
+
+    ifstream in(filename, ios::in | ios::binary);
+    if(in.fail() == true)
+        return false;
+    vector<uint8_t> data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+
+    if(data.size() < 4 or memcmp(data.data(), magic, 4) != 0) {
+        info("OpeningBook::load(): %s isn't a book", filename);
+        return false;
+    }
+    Cursor c = { data.data(), 4, data.size(), true };
+    if((int)c.get_uint() != version) {
+        info("OpeningBook::load(): %s has an unknown version", filename);
+        return false;
+    }
+
+    size_t count = c.get_uint();
+    m_entries.reserve(count);
+    for(size_t k = 0; k < count and c.ok == true; k++) {
+        Entry e;
+        e.m_hash = 0;
+        for(int i = 0; i < 8; i++) e.m_hash |= (uint64_t)c.get_byte() << (8 * i);
+        e.m_first = m_moves.size();
+        e.m_num = c.get_uint();
+        for(int i = 0; i < e.m_num and c.ok == true; i++) m_moves.push_back(get_move(c));
+        m_entries.push_back(e);
+    }
+
+    if(c.ok == false or is_sorted(m_entries.begin(), m_entries.end(), [](const Entry& a, const Entry& b) {
+                return a.m_hash < b.m_hash; }) == false) {
+        info("OpeningBook::load(): %s is damaged", filename);
+        m_entries.clear();
+        m_moves.clear();
+        return false;
+    }
+    debug("OpeningBook::load(): %s, %d positions", filename, m_entries.size());
+    return true;
+}
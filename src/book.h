@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "./board.h"
+
+/*
+  Opening book: the moves to make in positions the AI starts its turn
+  in, by Board::hash(). Built offline by avarice-book (src/booktool.cpp)
+  from self play on a map, and stored next to it as <map>.book.
+
+    "AVBK" version count, then count entries sorted by hash, each
+    hash (8 bytes, little endian) number-of-moves moves...
+
+  Numbers are varints, see varint.h.
+ */
+struct OpeningBook {
+    bool load(const char *filename);
+    bool save(const char *filename) const;
+
+    // replaces what's there for hash
+    void add(uint64_t hash, const std::vector<Move>& moves);
+    bool lookup(uint64_t hash, std::vector<Move>& out) const;
+    bool contains(uint64_t hash) const;
+    int size(void) const { return m_entries.size(); }
+
+private:
+    struct Entry {
+        uint64_t m_hash;
+        int m_first;
+        int m_num;
+    };
+    // sorted by hash
+    std::vector<Entry> m_entries;
+    std::vector<Move> m_moves;
+
+    const Entry *find(uint64_t hash) const;
+};
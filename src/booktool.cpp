@@ -0,0 +1,134 @@
+/*
+  avarice-book: builds the opening books for maps.
+
+    avarice-book [-turns n] [-lines n] [-replies n] [-time seconds] maps/China.map ...
+
+  For each map, plays -lines games against itself with the search AI
+  for -turns turns each and writes the moves of every turn to
+  maps/China.book. The lines use different seeds, so they also cover
+  some of the positions the other side's choices lead to.
+
+  A book position has to match the whole board, and the human playing
+  Red is unlikely to play exactly the same turn as the search did. So
+  at every Red turn of a line, -replies other Red turns are sampled
+  with short searches, and Blue's answer to each of them is searched
+  and added too.
+ */
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "./board.h"
+#include "./book.h"
+#include "./config.h"
+#include "./mapfile.h"
+#include "./mcts.h"
+#include "./ttable.h"
+#include "./util.h"
+#include "./workers.h"
+
+using namespace std;
+
+// for util.cpp
+Config cfg;
+bool debug_output = false;
+
+static void build_book(const char *filename, int turns, int lines, int replies,
+                       double time_budget, WorkerPool *pool, TranspositionTable *tt) {
+    ifstream in(filename, ios::in);
+    vector<MapFileHex> hexes;
+    if(in.fail() == true or read_map_file(in, hexes) == false) {
+        info("Couldn't read %s", filename);
+        return;
+    }
+
+    BoardTopology topo;
+    build_topology(hexes, cannon_min_range, cannon_max_range, topo);
+
+    // the position new_game() starts from
+    Board start(&topo);
+    for(int i = 0; i < (int)hexes.size(); i++) {
+        start.m_cells[i] = hexes[i].m_cell;
+    }
+    for(int s = 0; s < 2; s++) {
+        start.m_resources[s] = 12;
+        start.m_carriers[s] = 0;
+    }
+    start.m_turn = Side::Red;
+
+    MCTSParams params;
+    params.time_budget = time_budget;
+    params.iterations = 1 << 30;
+
+    // the sampled Red turns only have to be plausible
+    MCTSParams sample_params = params;
+    sample_params.time_budget = time_budget / 10;
+
+    OpeningBook book;
+    Board b(&topo);
+    Board alt(&topo);
+    vector<Move> moves;
+    for(int line = 0; line < lines; line++) {
+        MCTS mcts(&topo, params, line + 1, pool, tt);
+        b.copy_from(start);
+
+        for(int t = 0; t < turns and b.winner() == Side::Neutral; t++) {
+            for(int r = 0; b.m_turn == Side::Red and t + 1 < turns and r < replies; r++) {
+                MCTS sampler(&topo, sample_params, ((uint64_t)(line + 1) << 32) | (r + 1), pool, tt);
+                sampler.play_turn(b, moves);
+                alt.copy_from(b);
+                for(auto&& m : moves) alt.apply(m);
+                alt.apply({ MapAction::EndTurn, -1, -1, 0 });
+                if(alt.winner() != Side::Neutral or book.contains(alt.hash()) == true)
+                    continue;
+                mcts.play_turn(alt, moves);
+                book.add(alt.hash(), moves);
+            }
+
+            mcts.play_turn(b, moves);
+            // the first line to get somewhere decides what's played there
+            if(book.contains(b.hash()) == false)
+                book.add(b.hash(), moves);
+            for(auto&& m : moves) b.apply(m);
+            b.apply({ MapAction::EndTurn, -1, -1, 0 });
+        }
+        info("%s: line %d/%d, %d positions", filename, line + 1, lines, book.size());
+    }
+
+    string out = filename;
+    out = out.substr(0, out.rfind(".map")) + ".book";
+    if(book.save(out.c_str()) == false)
+        fatal_error("Couldn't write %s", out.c_str());
+    info("Wrote %s", out.c_str());
+}
+
+int main(int argc, char **argv) {
+    int turns = 6;
+    int lines = 8;
+    int replies = 4;
+    double time_budget = 10;
+    vector<const char *> maps;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-turns") == 0 and i + 1 < argc) turns = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-lines") == 0 and i + 1 < argc) lines = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-replies") == 0 and i + 1 < argc) replies = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-time") == 0 and i + 1 < argc) time_budget = atof(argv[++i]);
+        else maps.push_back(argv[i]);
+    }
+    if(maps.empty() == true) {
+        info("usage: %s [-turns n] [-lines n] [-replies n] [-time seconds] maps/China.map ...",
+             argv[0]);
+        return 1;
+    }
+
+    // a thread per core
+    WorkerPool pool(0);
+    TranspositionTable tt(20);
+    for(auto&& m : maps) {
+        build_book(m, turns, lines, replies, time_budget, &pool, &tt);
+    }
+    return 0;
+}
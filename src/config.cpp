@@ -2,13 +2,33 @@
 #include "./util.h"
 
 #include <stdio.h>
+#include <string.h>
+#include <algorithm>
 #include <allegro5/allegro.h>
 
+const char *ai_difficulty_names[AI_NUM_DIFFICULTIES] = {
+    "fast",
+    "normal",
+    "strong",
+};
+
+static const AIDifficultyProfile default_ai_difficulty[AI_NUM_DIFFICULTIES] = {
+    {  250,  1000, 2 },
+    { 2000,  4000, 4 },
+    { 6000, 16000, 6 },
+};
+
 static const char *with_default(const char *str, const char *def) {
     if(str == NULL) return def;
     else return str;
 }
 
+// e.g. ai-strong-iterations
+static const char *difficulty_key(char *buf, size_t size, int d, const char *what) {
+    snprintf(buf, size, "ai-%s-%s", ai_difficulty_names[d], what);
+    return buf;
+}
+
 void Config::save(const char *filename) {
     ALLEGRO_CONFIG *cfg = al_create_config();
     char buf[512];
@@ -48,6 +68,35 @@ void Config::save(const char *filename) {
     al_set_config_value(cfg, NULL, "log-to-file", buf);
     snprintf(buf, sizeof(buf), "%d", debug_output);
     al_set_config_value(cfg, NULL, "debug-output", buf);
+    snprintf(buf, sizeof(buf), "%d", ai_speculation);
+    al_set_config_value(cfg, NULL, "ai-speculation", buf);
+    snprintf(buf, sizeof(buf), "%d", ai_threads);
+    al_set_config_value(cfg, NULL, "ai-threads", buf);
+    snprintf(buf, sizeof(buf), "%llu", (unsigned long long)game_seed);
+    al_set_config_value(cfg, NULL, "game-seed", buf);
+    al_set_config_value(cfg, NULL, "ai-profile-file", ai_profile_file);
+    al_set_config_value(cfg, NULL, "ai-difficulty", ai_difficulty_names[ai_default_difficulty]);
+    snprintf(buf, sizeof(buf), "%d", ai_replay_batch_ms);
+    al_set_config_value(cfg, NULL, "ai-replay-batch-ms", buf);
+    snprintf(buf, sizeof(buf), "%d", ai_replay_max_ms);
+    al_set_config_value(cfg, NULL, "ai-replay-max-ms", buf);
+    al_set_config_value(cfg, NULL, "replay-dir", replay_dir);
+    snprintf(buf, sizeof(buf), "%d", lod_label_zoom);
+    al_set_config_value(cfg, NULL, "lod-label-zoom", buf);
+    snprintf(buf, sizeof(buf), "%d", lod_region_zoom);
+    al_set_config_value(cfg, NULL, "lod-region-zoom", buf);
+    al_set_config_value(cfg, NULL, "frame-profile-file", frame_profile_file);
+    snprintf(buf, sizeof(buf), "%d", hex_instancing);
+    al_set_config_value(cfg, NULL, "hex-instancing", buf);
+    for(int d = 0; d < AI_NUM_DIFFICULTIES; d++) {
+        char key[64];
+        snprintf(buf, sizeof(buf), "%d", ai_difficulty[d].time_budget_ms);
+        al_set_config_value(cfg, NULL, difficulty_key(key, sizeof(key), d, "time-ms"), buf);
+        snprintf(buf, sizeof(buf), "%d", ai_difficulty[d].iterations);
+        al_set_config_value(cfg, NULL, difficulty_key(key, sizeof(key), d, "iterations"), buf);
+        snprintf(buf, sizeof(buf), "%d", ai_difficulty[d].playout_turns);
+        al_set_config_value(cfg, NULL, difficulty_key(key, sizeof(key), d, "playout-turns"), buf);
+    }
 
     al_save_config_file(filename, cfg);
     al_destroy_config(cfg);
@@ -116,5 +165,79 @@ void Config::load(const char *filename) {
     s = al_get_config_value(cfg, 0, "debug-output");
     debug_output = atoi(with_default(s, "1"));
 
+    s = al_get_config_value(cfg, 0, "ai-speculation");
+    ai_speculation = atoi(with_default(s, "1"));
+
+    // 0 is one thread per core
+    s = al_get_config_value(cfg, 0, "ai-threads");
+    ai_threads = atoi(with_default(s, "0"));
+
+    // 0 picks a new seed for every game
+    s = al_get_config_value(cfg, 0, "game-seed");
+    game_seed = strtoull(with_default(s, "0"), NULL, 10);
+
+    // AI turn profiles are appended here, as CSV if it ends in .csv
+    // and JSON lines otherwise. Empty to not write them
+    s = al_get_config_value(cfg, 0, "ai-profile-file");
+    ai_profile_file = strdup(with_default(s, ""));
+
+    // preselected in the game setup
+    s = al_get_config_value(cfg, 0, "ai-difficulty");
+    ai_default_difficulty = AI_NORMAL;
+    for(int d = 0; d < AI_NUM_DIFFICULTIES; d++) {
+        if(s != NULL and strcmp(s, ai_difficulty_names[d]) == 0)
+            ai_default_difficulty = d;
+    }
+
+    // how long a batch of AI actions takes to play, and the most a
+    // whole AI turn takes
+    s = al_get_config_value(cfg, 0, "ai-replay-batch-ms");
+    ai_replay_batch_ms = atoi(with_default(s, "400"));
+
+    s = al_get_config_value(cfg, 0, "ai-replay-max-ms");
+    ai_replay_max_ms = atoi(with_default(s, "10000"));
+
+    // every game is recorded here. Empty to not record them
+    s = al_get_config_value(cfg, 0, "replay-dir");
+    replay_dir = strdup(with_default(s, "replays"));
+
+    // zoom in percent below which the map is drawn without labels, and
+    // below which it's drawn as one tile per chunk of hexes
+    s = al_get_config_value(cfg, 0, "lod-label-zoom");
+    lod_label_zoom = atoi(with_default(s, "50"));
+
+    s = al_get_config_value(cfg, 0, "lod-region-zoom");
+    lod_region_zoom = atoi(with_default(s, "20"));
+
+    // every frame's timings are written here as CSV. Empty to not
+    // write them
+    s = al_get_config_value(cfg, 0, "frame-profile-file");
+    frame_profile_file = strdup(with_default(s, ""));
+
+    // draw the map's hexes with one instanced draw if there's OpenGL
+    // 3.3
+    s = al_get_config_value(cfg, 0, "hex-instancing");
+    hex_instancing = atoi(with_default(s, "1"));
+
+    // time-ms <= 0 only stops the search on iterations, which makes it
+    // repeatable for a seed
+    for(int d = 0; d < AI_NUM_DIFFICULTIES; d++) {
+        char key[64];
+        char def[32];
+        const AIDifficultyProfile& p = default_ai_difficulty[d];
+
+        snprintf(def, sizeof(def), "%d", p.time_budget_ms);
+        s = al_get_config_value(cfg, 0, difficulty_key(key, sizeof(key), d, "time-ms"));
+        ai_difficulty[d].time_budget_ms = atoi(with_default(s, def));
+
+        snprintf(def, sizeof(def), "%d", p.iterations);
+        s = al_get_config_value(cfg, 0, difficulty_key(key, sizeof(key), d, "iterations"));
+        ai_difficulty[d].iterations = std::max(1, atoi(with_default(s, def)));
+
+        snprintf(def, sizeof(def), "%d", p.playout_turns);
+        s = al_get_config_value(cfg, 0, difficulty_key(key, sizeof(key), d, "playout-turns"));
+        ai_difficulty[d].playout_turns = std::max(1, atoi(with_default(s, def)));
+    }
+
     al_destroy_config(cfg);
 }
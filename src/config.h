@@ -2,6 +2,22 @@
 
 #include <cstdint>
 
+enum AIDifficulty {
+    AI_FAST,
+    AI_NORMAL,
+    AI_STRONG,
+    AI_NUM_DIFFICULTIES,
+};
+
+extern const char *ai_difficulty_names[AI_NUM_DIFFICULTIES];
+
+// how much the search based AI does per turn
+struct AIDifficultyProfile {
+    int time_budget_ms;
+    int iterations;
+    int playout_turns;
+};
+
 struct Config {
     int8_t frame_rate;
     bool vsync;
@@ -20,6 +36,19 @@ struct Config {
     bool esc_menu_quits;
     bool log_to_file;
     bool debug_output;
+    bool ai_speculation;
+    int8_t ai_threads;
+    uint64_t game_seed;
+    char *ai_profile_file;
+    AIDifficultyProfile ai_difficulty[AI_NUM_DIFFICULTIES];
+    int8_t ai_default_difficulty;
+    int ai_replay_batch_ms;
+    int ai_replay_max_ms;
+    char *replay_dir;
+    int16_t lod_label_zoom;
+    int16_t lod_region_zoom;
+    char *frame_profile_file;
+    bool hex_instancing;
 
     void save(const char *filename);
     void load(const char *filename);
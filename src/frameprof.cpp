@@ -0,0 +1,109 @@
+#include "./frameprof.h"
+
+#include <algorithm>
+
+#include "./util.h"
+
+using namespace std;
+
+FrameProfile *frame_prof = NULL;
+
+// frames kept for the overlay, a few seconds' worth
+static const int history_size = 240;
+
+static const char *stage_names[FRAME_NUM_STAGES] = {
+    "input",
+    "update",
+    "hexes",
+    "widgets",
+    "flip",
+};
+
+static const char *counter_names[FRAME_NUM_COUNTERS] = {
+    "hexes_drawn",
+    "draw_calls",
+    "text_calls",
+    "bfs_calls",
+};
+
+const char *frame_prof_stage_name(int stage) {
+    return stage_names[stage];
+}
+
+const char *frame_prof_counter_name(int counter) {
+    return counter_names[counter];
+}
+
+FrameProfile::FrameProfile() : m_history(history_size) {
+    m_busy = 0;
+    for(int i = 0; i < FRAME_NUM_STAGES; i++) m_stage_time[i] = 0;
+    for(int i = 0; i < FRAME_NUM_COUNTERS; i++) m_counters[i].store(0, memory_order_relaxed);
+    m_next = 0;
+    m_frames = 0;
+    m_frame = 0;
+}
+
+bool FrameProfile::open_csv(const char *filename) {
+    m_csv.open(filename, ios::out | ios::trunc);
+    if(m_csv.fail() == true) {
+        info("FrameProfile::open_csv(): couldn't open %s", filename);
+        return false;
+    }
+    m_csv << "frame,time";
+    for(int i = 0; i < FRAME_NUM_STAGES; i++) m_csv << "," << stage_names[i];
+    for(int i = 0; i < FRAME_NUM_COUNTERS; i++) m_csv << "," << counter_names[i];
+    m_csv << "\n";
+    return true;
+}
+
+void FrameProfile::end_frame(void) {
+    FrameSample& s = m_history[m_next];
+    s.m_time = m_busy;
+    for(int i = 0; i < FRAME_NUM_STAGES; i++) s.m_stage_time[i] = m_stage_time[i];
+    for(int i = 0; i < FRAME_NUM_COUNTERS; i++)
+        s.m_counters[i] = m_counters[i].exchange(0, memory_order_relaxed);
+
+    if(m_csv.is_open() == true) {
+        m_csv << m_frame << "," << s.m_time;
+        for(int i = 0; i < FRAME_NUM_STAGES; i++) m_csv << "," << s.m_stage_time[i];
+        for(int i = 0; i < FRAME_NUM_COUNTERS; i++) m_csv << "," << s.m_counters[i];
+        m_csv << "\n";
+    }
+
+    m_next = (m_next + 1) % history_size;
+    m_frames = min(m_frames + 1, history_size);
+    m_frame++;
+    m_busy = 0;
+    for(int i = 0; i < FRAME_NUM_STAGES; i++) m_stage_time[i] = 0;
+}
+
+const FrameSample& FrameProfile::last(void) const {
+    return m_history[(m_next + history_size - 1) % history_size];
+}
+
+double FrameProfile::percentile(double p) const {
+    if(m_frames == 0)
+        return 0;
+    // the history isn't in order, but that doesn't matter here
+    vector<double> times(m_frames);
+    for(int i = 0; i < m_frames; i++) times[i] = m_history[i].m_time;
+    const int k = min((int)(p / 100 * m_frames), m_frames - 1);
+    nth_element(times.begin(), times.begin() + k, times.end());
+    return times[k];
+}
+
+FrameSample FrameProfile::average(void) const {
+    FrameSample a = {};
+    for(int f = 0; f < m_frames; f++) {
+        const FrameSample& s = m_history[f];
+        a.m_time += s.m_time;
+        for(int i = 0; i < FRAME_NUM_STAGES; i++) a.m_stage_time[i] += s.m_stage_time[i];
+        for(int i = 0; i < FRAME_NUM_COUNTERS; i++) a.m_counters[i] += s.m_counters[i];
+    }
+    if(m_frames > 0) {
+        a.m_time /= m_frames;
+        for(int i = 0; i < FRAME_NUM_STAGES; i++) a.m_stage_time[i] /= m_frames;
+        for(int i = 0; i < FRAME_NUM_COUNTERS; i++) a.m_counters[i] /= m_frames;
+    }
+    return a;
+}
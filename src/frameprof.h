@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <vector>
+
+enum FrameStage {
+    FRAME_INPUT,
+    FRAME_UPDATE,
+    FRAME_HEXES,
+    FRAME_WIDGETS,
+    FRAME_FLIP,
+    FRAME_NUM_STAGES,
+};
+
+enum FrameCounter {
+    FRAME_HEXES_DRAWN,
+    FRAME_DRAW_CALLS,
+    FRAME_TEXT_CALLS,
+    FRAME_BFS_CALLS,
+    FRAME_NUM_COUNTERS,
+};
+
+const char *frame_prof_stage_name(int stage);
+const char *frame_prof_counter_name(int counter);
+
+// what one frame spent, from the first event after the last flip to
+// the end of this one, not counting the time spent waiting for events
+struct FrameSample {
+    double m_time;
+    double m_stage_time[FRAME_NUM_STAGES];
+    long m_counters[FRAME_NUM_COUNTERS];
+};
+
+/*
+  Times the stages of the frames and keeps the last frames for the
+  overlay. The counters are atomic because the AI's workers call BFS
+  too.
+ */
+struct FrameProfile {
+    FrameProfile();
+
+    void add_time(int stage, double seconds) { m_stage_time[stage] += seconds; }
+    double stage_time(int stage) const { return m_stage_time[stage]; }
+    void add_busy(double seconds) { m_busy += seconds; }
+    void count(int counter, long n = 1) {
+        m_counters[counter].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    // finishes the frame, adding it to the history and to the CSV file
+    // if one is open
+    void end_frame(void);
+
+    // appends every frame to filename from now on
+    bool open_csv(const char *filename);
+
+    // the frames in the history
+    int frames(void) const { return m_frames; }
+    // p-th percentile of the history's frame times, p from 0 to 100
+    double percentile(double p) const;
+    // average of the history
+    FrameSample average(void) const;
+    const FrameSample& last(void) const;
+
+private:
+    double m_busy;
+    double m_stage_time[FRAME_NUM_STAGES];
+    std::atomic<long> m_counters[FRAME_NUM_COUNTERS];
+
+    std::vector<FrameSample> m_history;
+    int m_next;
+    int m_frames;
+    long m_frame;
+
+    std::ofstream m_csv;
+};
+
+// the profile the frames report to, or NULL
+extern FrameProfile *frame_prof;
+
+static inline void frame_prof_count(int counter, long n = 1) {
+    if(frame_prof != NULL) frame_prof->count(counter, n);
+}
+
+// adds the time until the end of the scope to stage
+struct FrameProfTimer {
+    explicit FrameProfTimer(int stage)
+        : m_prof(frame_prof), m_stage(stage), m_start(std::chrono::steady_clock::now()) { }
+    ~FrameProfTimer() {
+        if(m_prof == NULL) return;
+        std::chrono::duration<double> d = std::chrono::steady_clock::now() - m_start;
+        m_prof->add_time(m_stage, d.count());
+    }
+private:
+    FrameProfile *m_prof;
+    int m_stage;
+    std::chrono::steady_clock::time_point m_start;
+};
@@ -0,0 +1,131 @@
+#include "./glyphbatch.h"
+
+#include <cstring>
+
+#include "./frameprof.h"
+#include "./util.h"
+
+// room around each glyph in the atlas for the parts that stick out of
+// its advance
+static const int pad = 2;
+
+GlyphBatch::GlyphBatch() {
+    m_atlas = NULL;
+    m_line_h = 0;
+    m_drawn = 0;
+    memset(m_glyphs, 0, sizeof(m_glyphs));
+}
+
+GlyphBatch::~GlyphBatch() {
+    // a global one outlives allegro, which destroys the atlas itself
+    if(m_atlas != NULL and al_is_system_installed() == true)
+        al_destroy_bitmap(m_atlas);
+}
+
+bool GlyphBatch::init(ALLEGRO_FONT *font, const char *chars) {
+    if(m_atlas != NULL)
+        al_destroy_bitmap(m_atlas);
+    m_atlas = NULL;
+    memset(m_glyphs, 0, sizeof(m_glyphs));
+
+    m_line_h = al_get_font_line_height(font);
+
+    // every glyph side by side in one row
+    char s[2] = { 0, 0 };
+    int w = 0;
+    for(const char *p = chars; *p != 0; p++) {
+        const unsigned char ch = *p;
+        if(ch >= 128) continue;
+        s[0] = ch;
+        Glyph& g = m_glyphs[ch];
+        g.m_ok = true;
+        g.m_advance = al_get_text_width(font, s);
+        g.m_w = g.m_advance + 2 * pad;
+        g.m_u = w;
+        w += g.m_w;
+    }
+
+    m_atlas = al_create_bitmap(w, m_line_h + 2 * pad);
+    if(m_atlas == NULL) {
+        info("GlyphBatch::init(): couldn't create the atlas");
+        memset(m_glyphs, 0, sizeof(m_glyphs));
+        return false;
+    }
+
+    ALLEGRO_STATE state;
+    al_store_state(&state, ALLEGRO_STATE_TARGET_BITMAP);
+    al_set_target_bitmap(m_atlas);
+    al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+    // white, so add() can tint it with the vertex color
+    for(int ch = 0; ch < 128; ch++) {
+        if(m_glyphs[ch].m_ok == false) continue;
+        s[0] = ch;
+        al_draw_text(font, al_map_rgb(255, 255, 255), m_glyphs[ch].m_u + pad, pad, 0, s);
+    }
+    al_restore_state(&state);
+
+    debug("GlyphBatch::init(): %dx%d atlas", w, (int)m_line_h + 2 * pad);
+    return true;
+}
+
+float GlyphBatch::add(float x, float y, char ch, ALLEGRO_COLOR c) {
+    const unsigned char i = ch;
+    if(i >= 128 or m_glyphs[i].m_ok == false)
+        return x;
+    const Glyph& g = m_glyphs[i];
+
+    const float x1 = x - pad;
+    const float y1 = y - pad;
+    const float x2 = x1 + g.m_w;
+    const float y2 = y1 + m_line_h + 2 * pad;
+    const float u1 = g.m_u;
+    const float u2 = g.m_u + g.m_w;
+    const float v2 = m_line_h + 2 * pad;
+
+    // two triangles, with u and v in pixels
+    const float quad[6][4] = {
+        { x1, y1, u1, 0 }, { x2, y1, u2, 0 }, { x2, y2, u2, v2 },
+        { x1, y1, u1, 0 }, { x2, y2, u2, v2 }, { x1, y2, u1, v2 },
+    };
+    ALLEGRO_VERTEX v;
+    v.z = 0;
+    v.color = c;
+    for(auto&& q : quad) {
+        v.x = q[0];
+        v.y = q[1];
+        v.u = q[2];
+        v.v = q[3];
+        m_verts.push_back(v);
+    }
+    return x + g.m_advance;
+}
+
+float GlyphBatch::add(float x, float y, const char *text, ALLEGRO_COLOR c) {
+    for(const char *p = text; *p != 0; p++) {
+        x = add(x, y, *p, c);
+    }
+    return x;
+}
+
+float GlyphBatch::add_int(float x, float y, int n, ALLEGRO_COLOR c) {
+    char buf[12];
+    int i = sizeof(buf) - 1;
+    buf[i] = 0;
+    // through unsigned, so INT_MIN doesn't overflow
+    unsigned u = n < 0 ? -(unsigned)n : n;
+    do {
+        buf[--i] = '0' + u % 10;
+        u /= 10;
+    } while(u > 0);
+    if(n < 0) buf[--i] = '-';
+    return add(x, y, buf + i, c);
+}
+
+void GlyphBatch::draw(void) {
+    m_drawn = m_verts.size() / 6;
+    if(m_verts.empty() == false) {
+        al_draw_prim(m_verts.data(), NULL, m_atlas, 0, m_verts.size(), ALLEGRO_PRIM_TRIANGLE_LIST);
+        frame_prof_count(FRAME_DRAW_CALLS);
+    }
+    m_verts.clear();
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_font.h>
+#include <allegro5/allegro_primitives.h>
+
+/*
+  Text made of a few characters, drawn as textured quads from an atlas
+  the characters are rendered into once, so all of it goes out in one
+  al_draw_prim() call. Numbers are turned into glyphs directly instead
+  of through printf.
+ */
+struct GlyphBatch {
+    GlyphBatch();
+    ~GlyphBatch();
+
+    // renders chars from font into the atlas. Needs a display
+    bool init(ALLEGRO_FONT *font, const char *chars);
+    bool ready(void) const { return m_atlas != NULL; }
+
+    // text at (x, y) like al_draw_text() with no flags. Returns where
+    // the text ends. Characters that aren't in the atlas are skipped
+    float add(float x, float y, const char *text, ALLEGRO_COLOR c);
+    float add(float x, float y, char ch, ALLEGRO_COLOR c);
+    float add_int(float x, float y, int n, ALLEGRO_COLOR c);
+    // draws everything added since the last draw()
+    void draw(void);
+
+    // glyphs in the last draw()
+    int m_drawn;
+
+private:
+    ALLEGRO_BITMAP *m_atlas;
+    float m_line_h;
+
+    struct Glyph {
+        bool m_ok;
+        float m_u;
+        float m_w;
+        float m_advance;
+    };
+    Glyph m_glyphs[128];
+
+    std::vector<ALLEGRO_VERTEX> m_verts;
+};
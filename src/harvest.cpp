@@ -0,0 +1,179 @@
+#include "./harvest.h"
+
+#include <algorithm>
+#include <cassert>
+
+using namespace std;
+
+// most search nodes solve() looks at before settling for the best so far
+static const long max_nodes = 20000;
+
+HarvesterPlanner::HarvesterPlanner(const BoardTopology *topo) {
+    m_topo = topo;
+    m_side = Side::Neutral;
+    m_valid = false;
+    m_best_total = 0;
+    m_nodes = 0;
+
+    const int n = topo->m_size;
+    m_level.assign(n, 0);
+    m_harvester.assign(n, 0);
+    m_covered.assign(n, 0);
+    m_score.assign(n, 0);
+    m_overlap.assign(n, 0);
+    m_cand.reserve(n);
+    m_pick.reserve(n);
+    m_best.reserve(n);
+    m_taken.assign(n, 0);
+}
+
+int HarvesterPlanner::value(int j) const {
+    return m_level[j] > 0 and m_covered[j] == 0 ? m_level[j] : 0;
+}
+
+// calls fn for i and its neighbors
+template<typename F>
+static inline void closed_neighbors(const BoardTopology *topo, int i, F fn) {
+    fn(i);
+    for(const int *n = topo->neighbors_begin(i); n != topo->neighbors_end(i); ++n) {
+        fn(*n);
+    }
+}
+
+void HarvesterPlanner::set_level(int j, int level) {
+    const int old_value = value(j);
+    m_level[j] = level;
+    const int d = value(j) - old_value;
+    if(d != 0) {
+        closed_neighbors(m_topo, j, [&](int i) { m_score[i] += d; });
+    }
+}
+
+void HarvesterPlanner::set_covered(int j, int delta) {
+    const int old_value = value(j);
+    const int old_covered = m_covered[j] > 0;
+    m_covered[j] += delta;
+    assert(m_covered[j] >= 0);
+    const int d = value(j) - old_value;
+    const int dc = (m_covered[j] > 0) - old_covered;
+    if(d != 0 or dc != 0) {
+        closed_neighbors(m_topo, j, [&](int i) {
+                m_score[i] += d;
+                m_overlap[i] += dc;
+            });
+    }
+}
+
+void HarvesterPlanner::add_harvester(int i, int delta) {
+    closed_neighbors(m_topo, i, [&](int j) { set_covered(j, delta); });
+}
+
+void HarvesterPlanner::update(const Board& b, Side side) {
+    assert(b.m_topo == m_topo);
+    const int n = m_topo->m_size;
+
+    if(m_valid == false or side != m_side) {
+        m_side = side;
+        m_covered.assign(n, 0);
+        m_score.assign(n, 0);
+        m_overlap.assign(n, 0);
+        for(int i = 0; i < n; i++) {
+            m_level[i] = b.m_cells[i].alive() ? b.m_cells[i].level : 0;
+            m_harvester[i] = 0;
+        }
+        // the scores are all 0 when nothing is covered, so build them
+        // up the same way as the updates do
+        for(int j = 0; j < n; j++) {
+            int v = value(j);
+            closed_neighbors(m_topo, j, [&](int i) { m_score[i] += v; });
+        }
+        m_valid = true;
+    }
+
+    for(int i = 0; i < n; i++) {
+        const Cell& c = b.m_cells[i];
+        const int level = c.alive() ? c.level : 0;
+        if(level != m_level[i])
+            set_level(i, level);
+
+        const uint8_t harvester = c.alive() and c.side == (uint8_t)side and c.has(CELL_HARVESTER);
+        if(harvester != m_harvester[i]) {
+            add_harvester(i, harvester ? 1 : -1);
+            m_harvester[i] = harvester;
+        }
+    }
+}
+
+bool HarvesterPlanner::conflicts(int i) const {
+    if(m_taken[i])
+        return true;
+    for(const int *n = m_topo->neighbors_begin(i); n != m_topo->neighbors_end(i); ++n) {
+        if(m_taken[*n])
+            return true;
+    }
+    return false;
+}
+
+void HarvesterPlanner::take(int i, int delta) {
+    closed_neighbors(m_topo, i, [&](int j) { m_taken[j] += delta; });
+}
+
+// branch and bound over m_cand, which is sorted by score, so the first
+// leaf is the greedy pick
+void HarvesterPlanner::search(int from, int total, int max_sites) {
+    if(++m_nodes > max_nodes)
+        return;
+
+    if(total > m_best_total) {
+        m_best_total = total;
+        m_best = m_pick;
+    }
+    if((int)m_pick.size() == max_sites)
+        return;
+
+    for(int k = from; k < (int)m_cand.size(); k++) {
+        // the rest can't beat the best even if they all fit
+        int bound = total;
+        int left = max_sites - m_pick.size();
+        for(int l = k; l < (int)m_cand.size() and left > 0; l++, left--) {
+            bound += m_score[m_cand[l]];
+        }
+        if(bound <= m_best_total)
+            return;
+
+        const int c = m_cand[k];
+        if(conflicts(c))
+            continue;
+
+        take(c, 1);
+        m_pick.push_back(c);
+        search(k + 1, total + m_score[c], max_sites);
+        m_pick.pop_back();
+        take(c, -1);
+    }
+}
+
+int HarvesterPlanner::solve(const int *candidates, int num_candidates, int max_sites, int *out) {
+    assert(m_valid);
+
+    m_cand.clear();
+    for(int k = 0; k < num_candidates; k++) {
+        int c = candidates[k];
+        if(m_overlap[c] == 0 and m_score[c] > 0)
+            m_cand.push_back(c);
+    }
+    sort(m_cand.begin(), m_cand.end(), [this](int a, int b) {
+            return m_score[a] != m_score[b] ? m_score[a] > m_score[b] : a < b; });
+
+    m_pick.clear();
+    m_best.clear();
+    m_best_total = 0;
+    m_nodes = 0;
+    if(max_sites > 0)
+        search(0, 0, max_sites);
+
+    for(size_t k = 0; k < m_best.size(); k++) {
+        out[k] = m_best[k];
+    }
+    return m_best.size();
+}
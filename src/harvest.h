@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+
+#include "./board.h"
+
+/*
+  Picks where to build harvesters. Like HexMap::harvest, a harvester
+  takes one level from its own hex and from each alive neighbor that
+  another of the side's harvesters didn't already take from that turn.
+  A site is scored by the levels around it that none of the side's
+  harvesters reach yet.
+
+  The scores are kept as neighbor sums and update() only rescores
+  around the hexes that changed, e.g. as they get depleted.
+ */
+struct HarvesterPlanner {
+    explicit HarvesterPlanner(const BoardTopology *topo);
+
+    // brings the scores up to date with b for side
+    void update(const Board& b, Side side);
+
+    // levels a harvester on i would take that no harvester takes yet
+    int score(int i) const { return m_score[i]; }
+    // hexes around i that a harvester already reaches
+    int overlap(int i) const { return m_overlap[i]; }
+
+    // writes to out up to max_sites of the candidates that don't
+    // overlap existing harvesters or each other, with the most total
+    // score. Returns how many
+    int solve(const int *candidates, int num_candidates, int max_sites, int *out);
+
+private:
+    const BoardTopology *m_topo;
+    Side m_side;
+    bool m_valid;
+
+    // what the scores were computed from, by hex
+    std::vector<int> m_level;
+    std::vector<uint8_t> m_harvester;
+
+    // number of the side's harvesters that reach each hex
+    std::vector<int> m_covered;
+    std::vector<int> m_score;
+    std::vector<int> m_overlap;
+
+    // scratch for solve()
+    std::vector<int> m_cand;
+    std::vector<int> m_pick;
+    std::vector<int> m_best;
+    std::vector<uint8_t> m_taken;
+    int m_best_total;
+    long m_nodes;
+
+    int value(int j) const;
+    void set_level(int j, int level);
+    void set_covered(int j, int delta);
+    void add_harvester(int i, int delta);
+    bool conflicts(int i) const;
+    void take(int i, int delta);
+    void search(int from, int total, int max_sites);
+};
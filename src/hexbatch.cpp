@@ -0,0 +1,55 @@
+#include "./hexbatch.h"
+
+#include "./frameprof.h"
+#include "./hexshape.h"
+
+HexBatch::HexBatch() {
+    m_size = 0;
+}
+
+void HexBatch::add(float x, float y, float a, ALLEGRO_COLOR c) {
+    ALLEGRO_VERTEX v;
+    v.z = 0;
+    v.u = 0;
+    v.v = 0;
+    v.color = c;
+
+    // a fan from the first corner, as 4 triangles
+    for(int i = 1; i < 5; i++) {
+        const int corners[3] = { 0, i, i + 1 };
+        for(int k : corners) {
+            v.x = x + hex_verts[k][0] * a;
+            v.y = y + hex_verts[k][1] * a;
+            m_verts.push_back(v);
+        }
+    }
+    m_size++;
+}
+
+void HexBatch::add_rect(float x1, float y1, float x2, float y2, ALLEGRO_COLOR c) {
+    ALLEGRO_VERTEX v;
+    v.z = 0;
+    v.u = 0;
+    v.v = 0;
+    v.color = c;
+
+    const float corners[6][2] = {
+        { x1, y1 }, { x2, y1 }, { x2, y2 },
+        { x1, y1 }, { x2, y2 }, { x1, y2 },
+    };
+    for(auto&& k : corners) {
+        v.x = k[0];
+        v.y = k[1];
+        m_verts.push_back(v);
+    }
+    m_size++;
+}
+
+void HexBatch::draw(void) {
+    if(m_verts.empty() == false) {
+        al_draw_prim(m_verts.data(), NULL, NULL, 0, m_verts.size(), ALLEGRO_PRIM_TRIANGLE_LIST);
+        frame_prof_count(FRAME_DRAW_CALLS);
+    }
+    m_verts.clear();
+    m_size = 0;
+}
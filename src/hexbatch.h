@@ -0,0 +1,29 @@
+#pragma once
+
+#include <vector>
+
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_primitives.h>
+
+/*
+  Collects hexes and draws them all with one al_draw_prim() call,
+  instead of a glBegin()/glEnd() and matrix push per hex like
+  draw_hex(). Hexes are drawn in the order they're added.
+ */
+struct HexBatch {
+    HexBatch();
+
+    // a hex centered on (x, y) with side a, same shape as draw_hex()
+    void add(float x, float y, float a, ALLEGRO_COLOR c);
+    // a rectangle, drawn in order with the hexes
+    void add_rect(float x1, float y1, float x2, float y2, ALLEGRO_COLOR c);
+    // draws everything added since the last draw()
+    void draw(void);
+
+    // shapes added since the last draw()
+    int size(void) const { return m_size; }
+
+private:
+    std::vector<ALLEGRO_VERTEX> m_verts;
+    int m_size;
+};
@@ -0,0 +1,249 @@
+#include "./hexgl.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+#include "./frameprof.h"
+#include "./hexshape.h"
+#include "./util.h"
+
+using namespace std;
+
+/*
+  The mesh is the marked outline's hexagon, a - 2. A fragment is in
+  the filled hexagon, a - 4, if it's inside all the edges pulled in
+  by (a - 4) / (a - 2). The rest is the white outline of a marked hex,
+  or nothing.
+ */
+static const char *vertex_source =
+    "#version 330\n"
+    "layout(location = 0) in vec2 a_corner;\n"
+    "layout(location = 1) in vec3 a_hex;\n"
+    "layout(location = 2) in uint a_flags;\n"
+    "uniform vec2 u_view;\n"
+    "uniform float u_scale;\n"
+    "uniform vec2 u_target;\n"
+    "out vec2 v_corner;\n"
+    "out float v_inner;\n"
+    "flat out uint v_flags;\n"
+    "void main() {\n"
+    "    float outer = max(a_hex.z - 2.0, 0.0);\n"
+    "    vec2 p = (a_hex.xy - u_view + a_corner * outer) * u_scale;\n"
+    "    gl_Position = vec4(p.x / u_target.x * 2.0 - 1.0, 1.0 - p.y / u_target.y * 2.0, 0.0, 1.0);\n"
+    "    v_corner = a_corner;\n"
+    "    v_inner = outer > 0.0 ? max(a_hex.z - 4.0, 0.0) / outer : 0.0;\n"
+    "    v_flags = a_flags;\n"
+    "}\n";
+
+static const char *fragment_source =
+    "#version 330\n"
+    "in vec2 v_corner;\n"
+    "in float v_inner;\n"
+    "flat in uint v_flags;\n"
+    "uniform vec3 u_edges[6];\n"
+    "uniform bool u_dim;\n"
+    "out vec4 color;\n"
+    "void main() {\n"
+    "    float g = 0.0;\n"
+    "    for(int i = 0; i < 6; i++)\n"
+    "        g = max(g, dot(u_edges[i].xy, v_corner) / u_edges[i].z);\n"
+    "    bool active = (v_flags & 4u) != 0u;\n"
+    "    bool marked = (v_flags & 8u) != 0u;\n"
+    "    if(g > v_inner) {\n"
+    "        if(marked == false) discard;\n"
+    "        color = vec4(1.0);\n"
+    "        return;\n"
+    "    }\n"
+    "    // the same colors as Hex::look()\n"
+    "    vec3 c = vec3(0.5);\n"
+    "    if((v_flags & 1u) != 0u) c = active ? vec3(0.98, 0.2, 0.2) : vec3(0.94, 0.5, 0.5);\n"
+    "    if((v_flags & 2u) != 0u) c = active ? vec3(0.2, 0.2, 0.98) : vec3(0.5, 0.5, 0.94);\n"
+    "    if(u_dim && marked == false && active == false) c /= 3.0;\n"
+    "    color = vec4(c, 1.0);\n"
+    "}\n";
+
+static GLuint compile(GLenum type, const char *source) {
+    GLuint s = glCreateShader(type);
+    glShaderSource(s, 1, &source, NULL);
+    glCompileShader(s);
+    GLint ok = 0;
+    glGetShaderiv(s, GL_COMPILE_STATUS, &ok);
+    if(ok == 0) {
+        char log[1024];
+        glGetShaderInfoLog(s, sizeof(log), NULL, log);
+        info("HexGL: shader didn't compile: %s", log);
+        glDeleteShader(s);
+        return 0;
+    }
+    return s;
+}
+
+HexGL::HexGL() {
+    m_program = 0;
+    m_vao = 0;
+    m_mesh = 0;
+    m_instances = 0;
+    m_capacity = 0;
+    m_u_view = m_u_scale = m_u_target = m_u_dim = -1;
+    m_dirty_begin = m_dirty_end = 0;
+    m_uploaded = 0;
+}
+
+HexGL::~HexGL() {
+    // a global one outlives allegro, and the context with it
+    if(al_is_system_installed() == true)
+        destroy();
+}
+
+void HexGL::destroy(void) {
+    if(m_program != 0) glDeleteProgram(m_program);
+    if(m_mesh != 0) glDeleteBuffers(1, &m_mesh);
+    if(m_instances != 0) glDeleteBuffers(1, &m_instances);
+    if(m_vao != 0) glDeleteVertexArrays(1, &m_vao);
+    m_program = m_vao = m_mesh = m_instances = 0;
+    m_capacity = 0;
+}
+
+bool HexGL::init(void) {
+    if(al_get_opengl_version() < 0x03030000) {
+        info("HexGL::init(): no OpenGL 3.3, not drawing hexes instanced");
+        return false;
+    }
+
+    GLuint vs = compile(GL_VERTEX_SHADER, vertex_source);
+    GLuint fs = compile(GL_FRAGMENT_SHADER, fragment_source);
+    if(vs == 0 or fs == 0) {
+        if(vs != 0) glDeleteShader(vs);
+        if(fs != 0) glDeleteShader(fs);
+        return false;
+    }
+    m_program = glCreateProgram();
+    glAttachShader(m_program, vs);
+    glAttachShader(m_program, fs);
+    glLinkProgram(m_program);
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+    GLint ok = 0;
+    glGetProgramiv(m_program, GL_LINK_STATUS, &ok);
+    if(ok == 0) {
+        info("HexGL::init(): shader didn't link");
+        destroy();
+        return false;
+    }
+
+    m_u_view = glGetUniformLocation(m_program, "u_view");
+    m_u_scale = glGetUniformLocation(m_program, "u_scale");
+    m_u_target = glGetUniformLocation(m_program, "u_target");
+    m_u_dim = glGetUniformLocation(m_program, "u_dim");
+
+    // each edge as its outward normal and distance from the center
+    GLfloat edges[6][3];
+    for(int i = 0; i < 6; i++) {
+        const float *p = hex_verts[i];
+        const float *q = hex_verts[(i + 1) % 6];
+        float nx = q[1] - p[1];
+        float ny = p[0] - q[0];
+        const float len = sqrt(nx * nx + ny * ny);
+        nx /= len;
+        ny /= len;
+        edges[i][0] = nx;
+        edges[i][1] = ny;
+        edges[i][2] = nx * p[0] + ny * p[1];
+    }
+
+    GLint old_program = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &old_program);
+    glUseProgram(m_program);
+    glUniform3fv(glGetUniformLocation(m_program, "u_edges"), 6, &edges[0][0]);
+    glUseProgram(old_program);
+
+    glGenVertexArrays(1, &m_vao);
+    glGenBuffers(1, &m_mesh);
+    glGenBuffers(1, &m_instances);
+
+    glBindVertexArray(m_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, m_mesh);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(hex_verts), hex_verts, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0);
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_instances);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(HexInstance),
+                          (const void *)offsetof(HexInstance, m_x));
+    glVertexAttribDivisor(1, 1);
+    glEnableVertexAttribArray(2);
+    glVertexAttribIPointer(2, 1, GL_UNSIGNED_INT, sizeof(HexInstance),
+                           (const void *)offsetof(HexInstance, m_flags));
+    glVertexAttribDivisor(2, 1);
+
+    // allegro's own drawing expects these unbound
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    info("HexGL::init(): drawing hexes instanced");
+    return true;
+}
+
+void HexGL::begin(int n) {
+    m_uploaded = 0;
+    if(n != (int)m_hexes.size()) {
+        m_hexes.assign(n, HexInstance());
+        m_dirty_begin = 0;
+        m_dirty_end = n;
+    }
+}
+
+void HexGL::hex(int i, const HexInstance& h) {
+    if(m_hexes[i] != h) {
+        m_hexes[i] = h;
+        if(m_dirty_begin >= m_dirty_end) {
+            m_dirty_begin = i;
+            m_dirty_end = i + 1;
+        } else {
+            m_dirty_begin = min(m_dirty_begin, i);
+            m_dirty_end = max(m_dirty_end, i + 1);
+        }
+    }
+}
+
+void HexGL::draw(float view_x, float view_y, float scale, bool dim) {
+    const int n = m_hexes.size();
+    if(n == 0)
+        return;
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_instances);
+    if(n > m_capacity) {
+        // room to grow, so the buffer isn't made again for every hex the
+        // editor adds
+        m_capacity = max(n, m_capacity * 2);
+        glBufferData(GL_ARRAY_BUFFER, m_capacity * sizeof(HexInstance), NULL, GL_DYNAMIC_DRAW);
+        m_dirty_begin = 0;
+        m_dirty_end = n;
+    }
+    if(m_dirty_begin < m_dirty_end) {
+        // one write of the span between the first and last changed hex
+        glBufferSubData(GL_ARRAY_BUFFER, m_dirty_begin * sizeof(HexInstance),
+                        (m_dirty_end - m_dirty_begin) * sizeof(HexInstance),
+                        &m_hexes[m_dirty_begin]);
+        m_uploaded = m_dirty_end - m_dirty_begin;
+        m_dirty_begin = m_dirty_end = 0;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    ALLEGRO_BITMAP *target = al_get_target_bitmap();
+    GLint old_program = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &old_program);
+    glUseProgram(m_program);
+    glUniform2f(m_u_view, view_x, view_y);
+    glUniform1f(m_u_scale, scale);
+    glUniform2f(m_u_target, al_get_bitmap_width(target), al_get_bitmap_height(target));
+    glUniform1i(m_u_dim, dim ? 1 : 0);
+
+    glBindVertexArray(m_vao);
+    glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, 6, n);
+    glBindVertexArray(0);
+    glUseProgram(old_program);
+    frame_prof_count(FRAME_DRAW_CALLS);
+}
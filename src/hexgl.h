@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_opengl.h>
+
+enum HexInstanceFlags {
+    HEX_INST_RED = 1,
+    HEX_INST_BLUE = 2,
+    HEX_INST_ACTIVE = 4,
+    HEX_INST_MARKED = 8,
+};
+
+// what the shader needs to draw a hex the way Hex::draw() does
+struct HexInstance {
+    float m_x;
+    float m_y;
+    // the side, 0 to not draw it
+    float m_a;
+    uint32_t m_flags;
+
+    bool operator!=(const HexInstance& o) const {
+        return m_x != o.m_x or m_y != o.m_y or m_a != o.m_a or m_flags != o.m_flags;
+    }
+};
+
+/*
+  Draws the map's hexes with one instanced draw of a hexagon, on
+  OpenGL 3.3. The hexes are kept in a buffer in world coordinates, so
+  panning and zooming don't upload anything, and a frame only uploads
+  the hexes that changed since the last one. The colors are worked out
+  in the shader from the side and flags, like Hex::look().
+ */
+struct HexGL {
+    HexGL();
+    ~HexGL();
+
+    // compiles the shader and makes the buffers. Returns false without
+    // OpenGL 3.3, in which case nothing else should be called
+    bool init(void);
+    bool ready(void) const { return m_program != 0; }
+
+    // starts a frame of n hexes. All n have to be given to hex() every
+    // frame, since the buffer is kept between frames and maps
+    void begin(int n);
+    void hex(int i, const HexInstance& h);
+    // uploads the changed hexes and draws all of them to the current
+    // target, for the view at (view_x, view_y) at scale. dim darkens
+    // the hexes that aren't marked or active
+    void draw(float view_x, float view_y, float scale, bool dim);
+
+    // hexes uploaded in the last draw()
+    int m_uploaded;
+
+private:
+    GLuint m_program;
+    GLuint m_vao;
+    GLuint m_mesh;
+    GLuint m_instances;
+    int m_capacity;
+
+    GLint m_u_view;
+    GLint m_u_scale;
+    GLint m_u_target;
+    GLint m_u_dim;
+
+    // what's in m_instances, and the range of it that has to be
+    // uploaded
+    std::vector<HexInstance> m_hexes;
+    int m_dirty_begin;
+    int m_dirty_end;
+
+    void destroy(void);
+};
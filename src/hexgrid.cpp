@@ -0,0 +1,126 @@
+#include "./hexgrid.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+HexGrid::HexGrid() {
+    m_size = 0;
+    m_x0 = m_y0 = 0;
+    m_cell = 1;
+    m_w = m_h = 0;
+    m_stamp = 0;
+}
+
+int HexGrid::cell_x(float x) const {
+    return min(max((int)floor((x - m_x0) / m_cell), 0), m_w - 1);
+}
+
+int HexGrid::cell_y(float y) const {
+    return min(max((int)floor((y - m_y0) / m_cell), 0), m_h - 1);
+}
+
+bool HexGrid::outside(float x1, float y1, float x2, float y2) const {
+    return m_size == 0 or x2 < m_x0 or y2 < m_y0 or
+        x1 > m_x0 + m_w * m_cell or y1 > m_y0 + m_h * m_cell;
+}
+
+void HexGrid::build(int n, const float *x, const float *y, const float *r) {
+    m_size = n;
+    m_bounds.resize(4 * n);
+    m_home.resize(n);
+    m_seen.assign(n, 0);
+    m_stamp = 0;
+    m_cell_start.clear();
+    m_items.clear();
+    if(n == 0) {
+        m_w = m_h = 0;
+        return;
+    }
+
+    float x1 = x[0], y1 = y[0], x2 = x[0], y2 = y[0];
+    float max_r = 0;
+    for(int i = 0; i < n; i++) {
+        m_bounds[4 * i + 0] = x[i] - r[i];
+        m_bounds[4 * i + 1] = y[i] - r[i];
+        m_bounds[4 * i + 2] = x[i] + r[i];
+        m_bounds[4 * i + 3] = y[i] + r[i];
+        x1 = min(x1, x[i] - r[i]);
+        y1 = min(y1, y[i] - r[i]);
+        x2 = max(x2, x[i] + r[i]);
+        y2 = max(y2, y[i] + r[i]);
+        max_r = max(max_r, r[i]);
+    }
+
+    // a few hexes to a cell
+    m_cell = max(4 * max_r, 1.0f);
+    m_x0 = x1;
+    m_y0 = y1;
+    m_w = (int)ceil((x2 - x1) / m_cell) + 1;
+    m_h = (int)ceil((y2 - y1) / m_cell) + 1;
+
+    for(int i = 0; i < n; i++) {
+        m_home[i] = cell_y(y[i]) * m_w + cell_x(x[i]);
+    }
+
+    // counting sort of the hexes into cells
+    vector<int> count(m_w * m_h + 1, 0);
+    for(int pass = 0; pass < 2; pass++) {
+        for(int i = 0; i < n; i++) {
+            for(int cy = cell_y(m_bounds[4 * i + 1]); cy <= cell_y(m_bounds[4 * i + 3]); cy++) {
+                for(int cx = cell_x(m_bounds[4 * i + 0]); cx <= cell_x(m_bounds[4 * i + 2]); cx++) {
+                    const int c = cy * m_w + cx;
+                    if(pass == 0) count[c + 1]++;
+                    else m_items[m_cell_start[c] + count[c]++] = i;
+                }
+            }
+        }
+        if(pass == 0) {
+            m_cell_start.assign(m_w * m_h + 1, 0);
+            for(int c = 0; c < m_w * m_h; c++) {
+                m_cell_start[c + 1] = m_cell_start[c] + count[c + 1];
+            }
+            m_items.resize(m_cell_start.back());
+            fill(count.begin(), count.end(), 0);
+        }
+    }
+}
+
+void HexGrid::query(float x1, float y1, float x2, float y2, vector<int>& out) {
+    if(outside(x1, y1, x2, y2) == true)
+        return;
+
+    if(++m_stamp == 0) {
+        fill(m_seen.begin(), m_seen.end(), 0);
+        m_stamp = 1;
+    }
+
+    const size_t first = out.size();
+    for(int cy = cell_y(y1); cy <= cell_y(y2); cy++) {
+        for(int cx = cell_x(x1); cx <= cell_x(x2); cx++) {
+            const int c = cy * m_w + cx;
+            for(int k = m_cell_start[c]; k < m_cell_start[c + 1]; k++) {
+                const int i = m_items[k];
+                if(m_seen[i] == m_stamp)
+                    continue;
+                m_seen[i] = m_stamp;
+                const float *b = &m_bounds[4 * i];
+                if(b[0] <= x2 and b[2] >= x1 and b[1] <= y2 and b[3] >= y1)
+                    out.push_back(i);
+            }
+        }
+    }
+    // draw order is map order
+    sort(out.begin() + first, out.end());
+}
+
+void HexGrid::cells_in(float x1, float y1, float x2, float y2, vector<int>& out) const {
+    if(outside(x1, y1, x2, y2) == true)
+        return;
+    for(int cy = cell_y(y1); cy <= cell_y(y2); cy++) {
+        for(int cx = cell_x(x1); cx <= cell_x(x2); cx++) {
+            out.push_back(cy * m_w + cx);
+        }
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+
+/*
+  Uniform grid over the hex centers, to find the hexes in a rectangle
+  without looking at all of them. Each hex is in every cell its
+  bounding square touches. Hexes don't move, so it's built once.
+ */
+struct HexGrid {
+    HexGrid();
+
+    // hex i is centered on (x[i], y[i]) and reaches radius r[i]
+    void build(int n, const float *x, const float *y, const float *r);
+    int size(void) const { return m_size; }
+
+    // appends the hexes whose bounds intersect the world rectangle to
+    // out, by index
+    void query(float x1, float y1, float x2, float y2, std::vector<int>& out);
+
+    // the cells, in rows from the top left, make chunks of the map. Each
+    // hex's home is the cell its center is in
+    int cells(void) const { return m_w * m_h; }
+    int home(int i) const { return m_home[i]; }
+    // appends the cells that overlap the world rectangle to out
+    void cells_in(float x1, float y1, float x2, float y2, std::vector<int>& out) const;
+
+private:
+    int m_size;
+    float m_x0;
+    float m_y0;
+    float m_cell;
+    int m_w;
+    int m_h;
+    std::vector<int> m_cell_start;
+    std::vector<int> m_items;
+    std::vector<float> m_bounds;
+    std::vector<int> m_home;
+    // query() has seen the hex in the query numbered m_stamp
+    std::vector<unsigned> m_seen;
+    unsigned m_stamp;
+
+    int cell_x(float x) const;
+    int cell_y(float y) const;
+    bool outside(float x1, float y1, float x2, float y2) const;
+};
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cmath>
+
+// the corners of a hexagon of size 1 centered on (0, 0), as drawn by
+// draw_hex(), HexBatch and HexGL
+constexpr static float hex_s12 = sin(1.0/2.0);
+constexpr static float hex_sqrt3div2 = 0.5*sqrt(3);
+constexpr static float hex_verts[6][2] =
+    { { -0.5,             -hex_sqrt3div2 },
+      {  0.5,             -hex_sqrt3div2 },
+      {  0.5 + hex_s12,    0 },
+      {  0.5,              hex_sqrt3div2 },
+      { -0.5,              hex_sqrt3div2 },
+      { -0.5 - hex_s12,    0 }
+    };
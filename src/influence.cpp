@@ -0,0 +1,168 @@
+#include "./influence.h"
+
+#include <cassert>
+#include <cmath>
+
+using namespace std;
+
+// more changed hexes than this and update() recomputes everything
+static const float update_fraction = 0.125;
+
+InfluenceMap::InfluenceMap(const BoardTopology *topo, int steps, float decay) {
+    m_topo = topo;
+    m_steps = steps;
+    m_decay = decay;
+    m_me = Side::Neutral;
+    m_valid = false;
+
+    const int n = topo->m_size;
+    m_friendly.assign(n, 0);
+    m_enemy.assign(n, 0);
+    m_cannon_threat.assign(n, 0);
+    m_friendly_src.assign(n, 0);
+    m_enemy_src.assign(n, 0);
+    m_armed_cannon.assign(n, 0);
+    m_alive.assign(n, 0);
+    m_cur.assign(n, 0);
+    m_next.assign(n, 0);
+}
+
+void InfluenceMap::read_sources(const Board& b, int i, float& friendly, float& enemy,
+                                uint8_t& cannon) const {
+    const Cell& c = b.m_cells[i];
+    friendly = 0;
+    enemy = 0;
+    cannon = 0;
+    if(c.alive() == false or c.side == (uint8_t)Side::Neutral)
+        return;
+
+    const float units = c.units_free + c.units_moved;
+    if(c.side == (uint8_t)m_me) {
+        friendly = units;
+    } else {
+        enemy = units;
+        // loaded ammo is ready on the enemy's next turn
+        cannon = c.has(CELL_CANNON) and c.has(CELL_AMMO | CELL_LOADED_AMMO);
+    }
+}
+
+// out = src spread over m_steps with m_decay, through alive hexes only
+void InfluenceMap::spread(const vector<float>& src, vector<float>& out) {
+    const int n = m_topo->m_size;
+
+    for(int i = 0; i < n; i++) {
+        m_cur[i] = m_alive[i] ? src[i] : 0;
+        out[i] = m_cur[i];
+    }
+
+    for(int s = 0; s < m_steps; s++) {
+        for(int i = 0; i < n; i++) {
+            float sum = 0;
+            for(const int *j = m_topo->neighbors_begin(i); j != m_topo->neighbors_end(i); ++j) {
+                sum += m_cur[*j];
+            }
+            m_next[i] = m_alive[i] ? m_decay * sum : 0;
+        }
+        for(int i = 0; i < n; i++) {
+            out[i] += m_next[i];
+        }
+        m_cur.swap(m_next);
+    }
+}
+
+// adds what spread() would give for amount on hex i alone
+void InfluenceMap::spread_from(int i, float amount, vector<float>& out) {
+    m_front.clear();
+    m_front.push_back({ i, amount });
+    out[i] += amount;
+
+    for(int s = 0; s < m_steps; s++) {
+        m_front_next.clear();
+        for(auto&& f : m_front) {
+            const float a = f.m_amount * m_decay;
+            for(const int *j = m_topo->neighbors_begin(f.m_cell); j != m_topo->neighbors_end(f.m_cell); ++j) {
+                if(m_alive[*j] == 0)
+                    continue;
+                out[*j] += a;
+                m_front_next.push_back({ *j, a });
+            }
+        }
+        m_front.swap(m_front_next);
+    }
+}
+
+void InfluenceMap::add_cannon(int i, int amount) {
+    for(const int *t = m_topo->cannon_begin(i); t != m_topo->cannon_end(i); ++t) {
+        m_cannon_threat[*t] += amount;
+    }
+}
+
+void InfluenceMap::compute(const Board& b, Side me) {
+    assert(b.m_topo == m_topo);
+    const int n = m_topo->m_size;
+    m_me = me;
+
+    for(int i = 0; i < n; i++) {
+        m_alive[i] = b.m_cells[i].alive();
+        read_sources(b, i, m_friendly_src[i], m_enemy_src[i], m_armed_cannon[i]);
+    }
+
+    spread(m_friendly_src, m_friendly);
+    spread(m_enemy_src, m_enemy);
+
+    m_cannon_threat.assign(n, 0);
+    for(int i = 0; i < n; i++) {
+        if(m_armed_cannon[i]) add_cannon(i, 1);
+    }
+
+    m_valid = true;
+}
+
+void InfluenceMap::update(const Board& b, Side me) {
+    assert(b.m_topo == m_topo);
+    const int n = m_topo->m_size;
+
+    if(m_valid == false or me != m_me) {
+        compute(b, me);
+        return;
+    }
+
+    // spreading depends on which hexes are alive, and a lot of changes
+    // are cheaper to do all at once
+    int changed = 0;
+    for(int i = 0; i < n; i++) {
+        float f, e;
+        uint8_t c;
+        read_sources(b, i, f, e, c);
+        if(m_alive[i] != b.m_cells[i].alive()) {
+            compute(b, me);
+            return;
+        }
+        if(f != m_friendly_src[i] or e != m_enemy_src[i] or c != m_armed_cannon[i])
+            changed++;
+    }
+    if(changed == 0)
+        return;
+    if(changed > update_fraction * n) {
+        compute(b, me);
+        return;
+    }
+
+    for(int i = 0; i < n; i++) {
+        float f, e;
+        uint8_t c;
+        read_sources(b, i, f, e, c);
+        if(f != m_friendly_src[i]) {
+            spread_from(i, f - m_friendly_src[i], m_friendly);
+            m_friendly_src[i] = f;
+        }
+        if(e != m_enemy_src[i]) {
+            spread_from(i, e - m_enemy_src[i], m_enemy);
+            m_enemy_src[i] = e;
+        }
+        if(c != m_armed_cannon[i]) {
+            add_cannon(i, (int)c - (int)m_armed_cannon[i]);
+            m_armed_cannon[i] = c;
+        }
+    }
+}
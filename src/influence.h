@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+
+#include "./board.h"
+
+/*
+  Where each side is strong on a Board. Units push pressure onto their
+  hex, and it spreads m_steps hexes out, multiplied by m_decay at every
+  step. Cannon threat counts the enemy cannons that can fire at a hex
+  on their next turn.
+
+  update() only spreads the change from the hexes that are different
+  from the last call, so calling it after every few actions is cheap.
+  Lookups are O(1).
+ */
+struct InfluenceMap {
+    InfluenceMap(const BoardTopology *topo, int steps = 3, float decay = 0.5);
+
+    // recomputes everything for side me on b
+    void compute(const Board& b, Side me);
+    // same as compute(), but only redoes the hexes that changed
+    void update(const Board& b, Side me);
+
+    float friendly(int i) const { return m_friendly[i]; }
+    float enemy(int i) const { return m_enemy[i]; }
+    // > 0 where the enemy is stronger
+    float balance(int i) const { return m_enemy[i] - m_friendly[i]; }
+    int cannon_threat(int i) const { return m_cannon_threat[i]; }
+
+private:
+    const BoardTopology *m_topo;
+    int m_steps;
+    float m_decay;
+    Side m_me;
+    bool m_valid;
+
+    std::vector<float> m_friendly;
+    std::vector<float> m_enemy;
+    std::vector<int> m_cannon_threat;
+
+    // what the values were computed from, by hex
+    std::vector<float> m_friendly_src;
+    std::vector<float> m_enemy_src;
+    std::vector<uint8_t> m_armed_cannon;
+    std::vector<uint8_t> m_alive;
+
+    // scratch for spreading
+    struct Front {
+        int m_cell;
+        float m_amount;
+    };
+    std::vector<float> m_cur;
+    std::vector<float> m_next;
+    std::vector<Front> m_front;
+    std::vector<Front> m_front_next;
+
+    void read_sources(const Board& b, int i, float& friendly, float& enemy,
+                      uint8_t& cannon) const;
+    void spread(const std::vector<float>& src, std::vector<float>& out);
+    void spread_from(int i, float amount, std::vector<float>& out);
+    void add_cannon(int i, int amount);
+};
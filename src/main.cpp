@@ -21,8 +21,14 @@
 #include <fstream>
 #include <sstream>
 #include <chrono>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
 
 #include <dirent.h>
+#include <sys/stat.h>
 
 #include "./util.h"
 #include "./version.h"
@@ -32,6 +38,25 @@
 #include "./button.h"
 #include "./sidebutton.h"
 #include "./ui.h"
+#include "./board.h"
+#include "./mcts.h"
+#include "./rng.h"
+#include "./ttable.h"
+#include "./influence.h"
+#include "./harvest.h"
+#include "./workers.h"
+#include "./aiprof.h"
+#include "./replay.h"
+#include "./book.h"
+#include "./mapfile.h"
+#include "./hexshape.h"
+#include "./hexbatch.h"
+#include "./maplayer.h"
+#include "./hexgrid.h"
+#include "./glyphbatch.h"
+#include "./frameprof.h"
+#include "./hexgl.h"
+#include "./preview.h"
 
 const char *prog_name = "Avarice inc.";
 bool debug_output = true;
@@ -78,9 +103,25 @@ vector<SideButton *> opt_buttons;
 MessageLog *msg;
 SideInfo *sideinfo1;
 SideInfo *sideinfo2;
+struct AISpeculation;
+AISpeculation *ai_spec;
+WorkerPool *ai_pool;
+TranspositionTable *ai_tt;
+// the last AI turn's profile, for the overlay
+AITurnProfile ai_last_profile;
+bool ai_have_profile;
 
 Config cfg;
 Colors colors;
+// scratch for drawing the map
+HexBatch hex_batch;
+// the hexes' numbers and letters
+GlyphBatch hex_labels;
+// the map's hexes on the GPU, if it can draw them instanced
+HexGL hex_gl;
+// frame timings, collected while they're shown or written out
+FrameProfile frame_profile;
+bool draw_frame_profile;
 
 inline float vx(float x) {
     return (x - view_x) * scale;
@@ -103,18 +144,6 @@ enum class GameType {
     NotLoaded,
 };
 
-enum class MapAction {
-    MovingUnits,
-    BuildHarvester,
-    DestroyHarvester,
-    AddAmmoToCannon,
-    BuildCannon,
-    FireCannon,
-    BuildWalker,
-    BuildArmory,
-    BuildCarrier,
-};
-
 enum class MapEditorAction {
     AddHealth,
     RemoveHealth,
@@ -148,6 +177,8 @@ const char *map_action_to_string(MapAction act) {
         return "build armory";
     } else if(act == MapAction::BuildCarrier) {
         return "build carrier";
+    } else if(act == MapAction::EndTurn) {
+        return "end turn";
     }
     return "bug";
 }
@@ -205,15 +236,19 @@ struct AIAction {
     int m_amount;
 };
 
+// connected hexes of one side. Its hexes and armories are ranges in
+// ai_data::hexes and ai_data::armories
 struct Blob {
     Side side;
+    int island;
     int level_sum;
 
-    vector<Hex *> all_hexes;
-    vector<Hex *> units;
-    vector<Hex *> harvesters;
-    vector<Hex *> armories;
-    vector<Hex *> cannons;
+    int first_hex;
+    int num_hexes;
+    int first_armory;
+    int num_armories;
+    int num_harvesters;
+    int num_cannons;
 
     int free_units;
     int moved_units;
@@ -221,31 +256,127 @@ struct Blob {
     void print(void);
 };
 
+// connected hexes of any side. Its blobs, hexes and hexes with free
+// units are ranges in ai_data::blobs, ai_data::hexes and ai_data::units
 struct island {
     int level_sum;
-    vector<Hex *> hexes;
-    vector<Hex *> units;
-    vector<Hex *> dying_hexes;
-    vector<Blob> my_blobs;
-    vector<Blob> enemy_blobs;
-    vector<Blob> neutral_blobs;
+    int first_hex;
+    int num_hexes;
+    int first_unit;
+    int num_units;
+    int first_blob;
+    int num_blobs;
+    int num_my_blobs;
+    int num_enemy_blobs;
+};
+
+// part of one of ai_data's arrays
+template<typename T>
+struct ai_range {
+    T *m_begin;
+    T *m_end;
+
+    T *begin(void) const { return m_begin; }
+    T *end(void) const { return m_end; }
+    int size(void) const { return m_end - m_begin; }
+    bool empty(void) const { return m_begin == m_end; }
+    T& front(void) const { return *m_begin; }
 };
 
+template<typename T>
+static inline ai_range<T> make_range(vector<T>& v, int first, int num) {
+    return ai_range<T> { v.data() + first, v.data() + first + num };
+}
+
+// size of the buffers for HexMap::legal_moves()
+const int max_legal_moves = 4096;
+
+/*
+  The map split into islands and blobs. Everything is stored once in
+  flat arrays, with the blobs of an island next to each other and the
+  hexes of a blob next to each other. The island lists are indices into
+  islands.
+
+  The arrays keep their capacity, so analyze() only allocates the first
+  time it's called.
+ */
 struct ai_data {
-    vector<Blob> all_my_blobs;
-    vector<Blob> all_enemy_blobs;
+    vector<Hex *> hexes;
+    // hexes with free units, by island
+    vector<Hex *> units;
+    // by blob
+    vector<Hex *> armories;
+    vector<Blob> blobs;
+    vector<island> islands;
+
+    vector<int> contested_islands;
+    vector<int> islands_with_me;
+    vector<int> islands_with_enemies;
+    vector<int> islands_with_me_only;
+    vector<int> islands_with_enemy_only;
+    vector<int> islands_with_neutral_only;
+
+    void analyze(HexMap *m, Side side);
+
+    ai_range<Hex *> blob_hexes(const Blob& b) {
+        return make_range(hexes, b.first_hex, b.num_hexes);
+    }
+    ai_range<Hex *> blob_armories(const Blob& b) {
+        return make_range(armories, b.first_armory, b.num_armories);
+    }
+    ai_range<Hex *> island_hexes(const island& i) {
+        return make_range(hexes, i.first_hex, i.num_hexes);
+    }
+    ai_range<Hex *> island_units(const island& i) {
+        return make_range(units, i.first_unit, i.num_units);
+    }
+    ai_range<Blob> island_blobs(const island& i) {
+        return make_range(blobs, i.first_blob, i.num_blobs);
+    }
+
+    // unit pressure and cannon threat for the side analyze() was called
+    // for. NULL if the map has no topology
+    unique_ptr<InfluenceMap> influence;
 
-    vector<island> all_islands;
-    vector<island> contested_islands;
-    vector<island> islands_with_me;
-    vector<island> islands_with_enemies;
-    vector<island> islands_with_me_only;
-    vector<island> islands_with_enemy_only;
-    vector<island> islands_with_neutral_only;
+    bool under_cannon_fire(Hex *h);
+    bool enemy_stronger(Hex *h);
 
-    void analyze(HexMap *m);
+    // harvester sites, NULL if the map has no topology
+    unique_ptr<HarvesterPlanner> harvester_planner;
+    // scratch for the planner's candidates
+    vector<int> sites;
+
+    // brings influence and harvester_planner up to date with m
+    void sync(HexMap *m, Side side);
+
+    // the other side, for AI engines that look ahead
+    int enemy_resources;
+    int enemy_carriers;
 
     vector<AIAction> actions;
+
+    // scratch for HexMap::legal_moves()
+    vector<Move> moves;
+
+    ai_data() : moves(max_legal_moves) { }
+
+private:
+    // scratch for analyze(), by hex index
+    vector<int> m_island_of;
+    vector<int> m_blob_of;
+    vector<int> m_queue;
+    // hex indices by island
+    vector<int> m_by_island;
+    vector<int> m_island_start;
+    // the map as of analyze(), for influence
+    unique_ptr<Board> m_board;
+
+    void flood(HexMap *m, int from, vector<int>& label, int value, bool ignore_sides);
+};
+
+enum class AIEngine {
+    Heuristic,
+    MCTS,
 };
 
 static void set_sideinfo_offsets(void);
@@ -259,7 +390,17 @@ public:
     int m_carriers;
     ALLEGRO_COLOR m_color;
     bool m_ai_control;
+    AIEngine m_engine;
+    AIDifficulty m_difficulty;
+    // seeds anything random the AI does, from the game's Rng
+    uint64_t m_seed;
+    // the map's opening book, or NULL
+    const OpeningBook *m_book;
     HexMap *m_map;
+    // private copy used for speculative AI work, doesn't touch the UI
+    bool m_shadow;
+    // the AI stops planning early when this is set, or NULL
+    const atomic<bool> *m_cancel;
 
     SideController() { }
 
@@ -268,7 +409,13 @@ public:
         m_carriers = 0;
         m_side = s;
         m_ai_control = true;
+        m_engine = AIEngine::Heuristic;
+        m_difficulty = AI_NORMAL;
+        m_seed = 0;
+        m_book = NULL;
         m_map = NULL;
+        m_shadow = false;
+        m_cancel = NULL;
 
         if(s == Side::Red) {
             m_name = "Red";
@@ -286,12 +433,15 @@ public:
     vector<Hex *> my_hexes(void);
     vector<Hex *> my_hexes_with_free_units(void);
     bool harvester_nearby(Hex *);
-    bool building_nearby(Hex *);
 
     bool is_AI(void) {
         return m_ai_control;
     }
 
+    bool ai_cancelled(void) const {
+        return m_cancel != NULL and m_cancel->load(memory_order_relaxed) == true;
+    }
+
     int get_resources(void) {
         assert(m_resources >= 0);
         return m_resources;
@@ -299,7 +449,11 @@ public:
     void add_resources(int n) {
         m_resources += n;
         assert(m_resources >= 0);
-        set_sideinfo_offsets();
+        if(m_shadow == false)
+            set_sideinfo_offsets();
+    }
+    void pay(int n) {
+        add_resources(-n);
     }
 
     void ai_buy_transport(ai_data &ai);
@@ -311,15 +465,19 @@ public:
     void ai_blob_build_armories(ai_data& ai, Blob& blob);
     void ai_blob_transport(ai_data& ai, island& from, island& to);
 
-    vector<AIAction> do_AI(void);
+    void ai_plan(ai_data& ai);
+    void ai_plan_islands(ai_data& ai);
+    void ai_island_phase(ai_data& ai, int island, int phase);
+    bool ai_commit(ai_data& ai, const Move& m);
+    void ai_plan_mcts(ai_data& ai);
+    void ai_commit_moves(ai_data& ai, const vector<Move>& moves);
+    vector<AIAction> do_AI(SideController *enemy);
 };
 
 struct HexMap {
     int m_moving_units = 1;
     int m_buying_units = 1;
     const int m_max_units_moved = 8;
-    const float m_cannon_min_range = 1;
-    const float m_cannon_max_range = 5;
 
     vector<Hex *> m_hexes;
 
@@ -330,19 +488,67 @@ struct HexMap {
 
     vector<StoredState> m_old_states;
     vector<vector<Hex *>> m_neighbors;
+    // neighbors and cannon ranges by index, for the AI's Board
+    shared_ptr<BoardTopology> m_topology;
+
+    // backing storage for copies made with clone()
+    vector<Hex> m_own_hexes;
+    // scratch for legal_moves()
+    unique_ptr<Board> m_board;
+    // the hexes by position, for drawing and clicking only the ones
+    // that can be seen
+    HexGrid m_grid;
+    vector<int> m_grid_hits;
+
+    // the hexes whose center is in each of m_grid's cells, and the
+    // world rectangle they cover, for drawing the map zoomed far out
+    struct Region {
+        float m_x1;
+        float m_y1;
+        float m_x2;
+        float m_y2;
+        vector<Hex *> m_hexes;
+        // the average color of the live hexes, and marked_hexes() when
+        // it was worked out. m_stale is set by restyle()
+        ALLEGRO_COLOR m_color;
+        int m_alive;
+        bool m_dim;
+        bool m_stale;
+    };
+    vector<Region> m_regions;
+    // the region of each hex
+    vector<int> m_hex_region;
 
     HexMap() { }
     ~HexMap();
 
+    HexMap *clone(void);
+    uint64_t hash(void);
+
     void save(ostream &os);
     void load(istream &is, bool prune);
     void prune(void);
 
     float hex_distance(Hex *h1, Hex *h2);
     void gen_neighbors(void);
+    void gen_topology(void);
+    // the world rectangle the hexes are in
+    void bounds(float& x1, float& y1, float& x2, float& y2);
+    // appends the hexes that reach into the world rectangle to out, in
+    // map order
+    void hexes_in(float x1, float y1, float x2, float y2, vector<Hex *>& out);
+    // same for the regions that have hexes
+    void regions_in(float x1, float y1, float x2, float y2, vector<Region *>& out);
+    void update_grid(void);
+    // h's side, active, marked or alive changed, so its region's color
+    // has to be worked out again
+    void restyle(Hex *h);
+    void to_board(Board& b);
+    int legal_moves(SideController *s, Move *buf, int cap,
+                    unsigned actions, int src = -1);
     vector<Hex *> neighbors(Hex *base);
     bool is_neighbor(Hex *h1, Hex *h2);
-    void harvest(void);
+    void harvest(SideController *s);
     void build_harvester(Hex *h);
     void destroy_harvester(Hex *h);
     void build_cannon(Hex *h);
@@ -351,15 +557,18 @@ struct HexMap {
     void fire_cannon(Hex *from, Hex *to);
     bool cannon_in_range(Hex *from, Hex *to);
     void move_or_attack(Hex *attacker, Hex *defender);
-    void free_units(void);
+    void free_units(Side s);
     Hex *get_active_hex(void);
 
-    Hex *nearest(Hex *from, vector<Hex *> to);
+    Hex *nearest(Hex *from, Hex *const *begin, Hex *const *end);
     vector<Hex *> BFS(Hex *, int range, Side s, bool base_neighbors, bool ignore_sides);
     vector<Hex *> BFS(Hex *, int range);
     vector<Hex *> pathfind(Hex *from, Hex *to);
     vector<vector<Hex *>> islands(void);
 
+    // starts h's death animation if it just died on the map being played
+    void dying(Hex *h);
+
     void store_current_state(void);
     void clear_old_states(void);
     void undo(void);
@@ -368,13 +577,26 @@ struct HexMap {
 static void clear_active_hex(void);
 void btn_outlines_update(void);
 
+/*
+  All randomness in a game comes from m_rng, so a map, the seed and the
+  list of actions taken replay the same game.
+ */
 struct Game {
     GameType m_type;
     vector<SideController *> m_players;
     SideController *m_current_controller;
-
-    Game(GameType t, HexMap *m, int sides) {
+    // number of turns ended
+    int m_turn;
+    uint64_t m_seed;
+    Rng m_rng;
+    // records the game if it's open
+    ReplayWriter m_replay;
+    OpeningBook m_book;
+
+    Game(GameType t, HexMap *m, int sides, uint64_t seed) : m_rng(seed) {
         m_type = t;
+        m_turn = 0;
+        m_seed = seed;
         m_players.push_back(new SideController(Side::Red));
         m_players.push_back(new SideController(Side::Blue));
         if(sides == 3) {
@@ -383,7 +605,10 @@ struct Game {
         if(sides == 4) {
             m_players.push_back(new SideController(Side::Green));
         }
-        for(auto&& p : m_players) { p->m_map = m; }
+        for(auto&& p : m_players) {
+            p->m_map = m;
+            p->m_seed = m_rng.next();
+        }
 
         m_current_controller = m_players[0];
     }
@@ -392,6 +617,7 @@ struct Game {
     }
 
     SideController *get_next_controller();
+    SideController *peek_next_controller();
 
     SideController *controller(void) {
         return m_current_controller;
@@ -399,6 +625,12 @@ struct Game {
     int& controller_carriers(void) {
         return controller()->m_carriers;
     }
+    SideController *opponent(SideController *s) {
+        for(auto&& p : m_players) {
+            if(p != s) { return p; }
+        }
+        return NULL;
+    }
     void controller_pay(int n) {
         m_current_controller->add_resources(-n);
         btn_outlines_update();
@@ -425,6 +657,7 @@ Side get_current_side(void) {
 
 SideController *Game::get_next_controller() {
     vector<SideController *>::iterator it = find(m_players.begin(), m_players.end(), m_current_controller);
+    m_turn++;
 
     // wrap around
     if(++it == m_players.end()) {
@@ -437,6 +670,15 @@ SideController *Game::get_next_controller() {
     return m_current_controller;
 }
 
+SideController *Game::peek_next_controller() {
+    vector<SideController *>::iterator it = find(m_players.begin(), m_players.end(), m_current_controller);
+
+    if(++it == m_players.end()) {
+        return m_players[0];
+    }
+    return *it;
+}
+
 struct SideInfo : Widget {
     SideController *m_s;
     float m_x_off;
@@ -566,7 +808,8 @@ struct Hex : Widget {
     void update(void) override {
         if(m_level == 0) {
             if(m_a > 5) {
-                m_a -= 0.1 * m_circle_bb_radius;
+                // as fast as 0.1 a tick at the old fixed 30Hz
+                m_a -= 3 * dt * m_circle_bb_radius;
             }
             else {
                 m_level = -1;
@@ -575,7 +818,13 @@ struct Hex : Widget {
         }
     }
 
+    // shrinking away after dying
+    bool animating(void) override {
+        return m_level == 0;
+    }
+
     inline void draw_text(float x, float y, ALLEGRO_COLOR& txt_color) {
+        frame_prof_count(FRAME_TEXT_CALLS);
         float fx = floor(x);
         float fy = floor(y);
         al_draw_textf(g_font,
@@ -611,11 +860,39 @@ struct Hex : Widget {
                           0, "%d/%d", m_units_free, m_units_moved);
     }
 
-    void draw(void) override {
-        if(m_level == -1) return;
+    // same as draw_text(), into labels
+    void draw_text(GlyphBatch& labels, float x, float y, ALLEGRO_COLOR& txt_color) {
+        if(labels.ready() == false) {
+            draw_text(x, y, txt_color);
+            return;
+        }
 
-        float r, g, b;
+        frame_prof_count(FRAME_TEXT_CALLS);
+        float fx = floor(x);
+        float fy = floor(y);
+        labels.add_int(fx - 5, fy - 7, m_level, txt_color);
+
+        if(m_contains_harvester == true)
+            labels.add(fx - 25, fy - 25, 'H', txt_color);
+
+        if(m_contains_armory == true)
+            labels.add(fx - 5, fy - 25, 'A', txt_color);
+
+        if(m_contains_cannon == true)
+            labels.add(fx + 15, fy - 25, 'C', txt_color);
+
+        if(m_ammo or m_loaded_ammo)
+            labels.add(fx + 15, fy - 7, '1', txt_color);
 
+        if(m_units_free > 0 or m_units_moved > 0) {
+            float tx = labels.add_int(fx - 12, fy + 10, m_units_free, txt_color);
+            tx = labels.add(tx, fy + 10, '/', txt_color);
+            labels.add_int(tx, fy + 10, m_units_moved, txt_color);
+        }
+    }
+
+    // fill and text colors for draw()
+    void look(float& r, float& g, float& b, ALLEGRO_COLOR& txt_color) {
         if(m_side == Side::Red) {
             if(m_active == true) { r = 0.98; g = 0.2; b = 0.2; }
             else { r = 0.94; g = 0.5; b = 0.5; }
@@ -628,7 +905,22 @@ struct Hex : Widget {
             r = 0.5; g = 0.5; b = 0.5;
         }
 
-        ALLEGRO_COLOR txt_color = colors.white;
+        txt_color = colors.white;
+
+        if(m_marked == false and m_active == false and marked_hexes() == true) {
+            r /= 3;
+            g /= 3;
+            b /= 3;
+            txt_color = colors.grey_middle;
+        }
+    }
+
+    void draw(void) override {
+        if(m_level == -1) return;
+
+        float r, g, b;
+        ALLEGRO_COLOR txt_color;
+        look(r, g, b, txt_color);
 
         const float x = vx(m_cx);
         const float y = vy(m_cy);
@@ -637,12 +929,6 @@ struct Hex : Widget {
             const float space = 2;
             draw_hex(x, y, scale * (m_a - space), 0, 1, 1, 1);
         }
-        else if(m_active == false and marked_hexes() == true) {
-            r /= 3;
-            g /= 3;
-            b /= 3;
-            txt_color = colors.grey_middle;
-        }
 
         const float space = 4;
 
@@ -653,8 +939,72 @@ struct Hex : Widget {
         draw_text(x, y, txt_color);
     }
 
-    void draw_editor(void) {
+    // same as draw(), but the hex goes into batch and the text is left
+    // for draw_label(), so all the hexes can be drawn at once
+    void draw(HexBatch& batch) {
+        if(m_level == -1) return;
+
+        float r, g, b;
+        ALLEGRO_COLOR txt_color;
+        look(r, g, b, txt_color);
+
+        const float x = vx(m_cx);
+        const float y = vy(m_cy);
+
+        if(m_marked == true) {
+            const float space = 2;
+            batch.add(x, y, scale * (m_a - space), colors.white);
+        }
+
+        const float space = 4;
+
+        batch.add(x, y, scale * (m_a - space), al_map_rgb_f(r, g, b));
+    }
+
+    // same as draw(HexBatch&), with the colors left to the shader
+    void draw(HexGL& gl) {
+        HexInstance inst;
+        inst.m_x = m_cx;
+        inst.m_y = m_cy;
+        inst.m_a = m_level == -1 ? 0 : m_a;
+        inst.m_flags = 0;
+        if(m_side == Side::Red) inst.m_flags |= HEX_INST_RED;
+        if(m_side == Side::Blue) inst.m_flags |= HEX_INST_BLUE;
+        if(m_active == true) inst.m_flags |= HEX_INST_ACTIVE;
+        if(m_marked == true) inst.m_flags |= HEX_INST_MARKED;
+        gl.hex(m_index, inst);
+    }
+
+    // same as draw(HexBatch&), through the cached layer
+    void draw(MapLayer& layer) {
         float r, g, b;
+        ALLEGRO_COLOR txt_color;
+        look(r, g, b, txt_color);
+
+        const float a = m_level == -1 ? 0 : m_a;
+        uint32_t a_bits;
+        memcpy(&a_bits, &a, sizeof(a_bits));
+        const uint64_t sig =
+            (uint64_t)(r * 255)
+            | ((uint64_t)(g * 255) << 8)
+            | ((uint64_t)(b * 255) << 16)
+            | ((uint64_t)m_marked << 24)
+            | ((uint64_t)a_bits << 32);
+
+        layer.hex(m_index, sig, m_cx, m_cy, a, m_marked, al_map_rgb_f(r, g, b));
+    }
+
+    void draw_label(GlyphBatch& labels) {
+        if(m_level < 1) return;
+
+        float r, g, b;
+        ALLEGRO_COLOR txt_color;
+        look(r, g, b, txt_color);
+
+        draw_text(labels, vx(m_cx), vy(m_cy), txt_color);
+    }
+
+    void editor_look(float& r, float& g, float& b) {
 
         if(m_side == Side::Red) {
             r = 0.94; g = 0.5; b = 0.5;
@@ -671,6 +1021,11 @@ struct Hex : Widget {
             g /= 3;
             b /= 3;
         }
+    }
+
+    void draw_editor(void) {
+        float r, g, b;
+        editor_look(r, g, b);
 
         const int x = vx(m_cx);
         const int y = vy(m_cy);
@@ -683,6 +1038,24 @@ struct Hex : Widget {
         draw_text(x, y, txt_color);
     }
 
+    // draw_editor() in two passes, like draw(HexBatch&)
+    void draw_editor(HexBatch& batch) {
+        float r, g, b;
+        editor_look(r, g, b);
+
+        const int x = vx(m_cx);
+        const int y = vy(m_cy);
+
+        const float space = 4;
+
+        batch.add(x, y, scale * (m_a - space), al_map_rgb_f(r, g, b));
+    }
+
+    void draw_editor_label(GlyphBatch& labels) {
+        ALLEGRO_COLOR txt_color = colors.white;
+        draw_text(labels, (int)vx(m_cx), (int)vy(m_cy), txt_color);
+    }
+
     void mouseDownEvent(void) override {
         if(m_level < 1)
             return;
@@ -720,20 +1093,64 @@ HexMap::~HexMap()
 {
 }
 
-bool SideController::building_nearby(Hex *h) {
-    if(h->m_contains_harvester == true or
-       h->m_contains_armory == true or
-       h->m_contains_cannon == true)
-        return true;
+// copies the hexes and the neighbor lists into a new map that owns them.
+// Undo states aren't copied
+HexMap *HexMap::clone(void) {
+    ai_prof_count(AI_PROF_MAP_CLONES);
+    HexMap *ret = new HexMap;
+    ret->m_moving_units = m_moving_units;
+    ret->m_buying_units = m_buying_units;
+    ret->m_topology = m_topology;
+
+    // everything is reserved up front, so these are all the allocations:
+    // the map, the hexes, the hex pointers, the neighbor lists, and each
+    // hex's neighbors
+    ret->m_own_hexes.reserve(m_hexes.size());
+    ret->m_hexes.reserve(m_hexes.size());
+    ret->m_neighbors.reserve(m_neighbors.size());
+    ai_prof_count(AI_PROF_ALLOCATIONS, 4);
 
-    for(auto&& n : m_map->neighbors(h)) {
-        if(n->m_contains_harvester == true or
-           h->m_contains_armory == true or
-           h->m_contains_cannon == true) {
-            return true;
+    for(auto&& h : m_hexes) {
+        ret->m_own_hexes.push_back(*h);
+    }
+    for(auto&& h : ret->m_own_hexes) {
+        ret->m_hexes.push_back(&h);
+    }
+    for(auto&& ns : m_neighbors) {
+        ret->m_neighbors.emplace_back();
+        vector<Hex *>& cns = ret->m_neighbors.back();
+        if(ns.empty() == false) {
+            cns.reserve(ns.size());
+            ai_prof_count(AI_PROF_ALLOCATIONS);
+        }
+        for(auto&& n : ns) {
+            cns.push_back(ret->m_hexes[n->m_index]);
         }
     }
-    return false;
+    return ret;
+}
+
+static inline uint64_t hash_mix(uint64_t h, uint64_t v) {
+    h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+    return h;
+}
+
+// hash of everything that the rules and the AI look at
+uint64_t HexMap::hash(void) {
+    uint64_t ret = 0xcbf29ce484222325ULL;
+    for(auto&& h : m_hexes) {
+        uint64_t flags =
+            (h->m_contains_harvester << 0) |
+            (h->m_contains_armory << 1) |
+            (h->m_contains_cannon << 2) |
+            (h->m_ammo << 3) |
+            (h->m_loaded_ammo << 4);
+        ret = hash_mix(ret, (uint64_t)(uint32_t)h->m_level);
+        ret = hash_mix(ret, (uint64_t)h->m_side | (flags << 8));
+        ret = hash_mix(ret, ((uint64_t)(uint32_t)h->m_units_free << 32) |
+                            (uint32_t)h->m_units_moved);
+    }
+    return ret;
 }
 
 bool SideController::harvester_nearby(Hex *h) {
@@ -771,90 +1188,88 @@ vector<Hex *> SideController::my_hexes_with_free_units(void) {
 
 void Blob::print(void) {
     debug("BLOB %d %d hexes: %d, har: %d, ar: %d, can: %d, units: %d/%d",
-          level_sum, side, all_hexes.size(), harvesters.size(),
-          armories.size(), cannons.size(), free_units, moved_units);
-}
-
-Blob blob_analyze(vector<Hex *>& hexes) {
-    Blob b;
-    b.level_sum = 0;
-    b.free_units = 0;
-    b.moved_units = 0;
-    b.side = hexes.front()->m_side;
-    for(auto&& h : hexes) {
-        b.level_sum += h->m_level;
-        b.all_hexes.push_back(h);
-        if(h->m_contains_harvester == true) { b.harvesters.push_back(h); }
-        if(h->m_contains_cannon == true) { b.cannons.push_back(h); }
-        if(h->m_contains_armory == true) { b.armories.push_back(h); }
-        if(h->m_units_free > 0) { b.free_units += h->m_units_free;
-            b.units.push_back(h);
-        }
-        if(h->m_units_moved > 0) { b.moved_units += h->m_units_moved;
-        }
-    }
-    return b;
+          level_sum, side, num_hexes, num_harvesters,
+          num_armories, num_cannons, free_units, moved_units);
 }
 
-vector<vector<Hex *>> find_clusters(HexMap* m, vector<Hex *>& hexes);
-
 void SideController::ai_buy_transport(ai_data &ai) {
-    if(game->controller_has_resources(50) and game->controller()->m_carriers <= 1) {
-        game->controller_pay(50);
-        game->controller()->m_carriers += 1;
+    if(get_resources() >= 50 and m_carriers <= 1) {
+        pay(50);
+        m_carriers += 1;
         ai.actions.push_back(AIAction(MapAction::BuildCarrier, NULL, NULL, -1));
     }
 }
 
 void SideController::ai_blob_transport(ai_data& ai, island& from, island& to) {
-    Hex *to_go = from.units.front();
+    Hex *to_go = ai.island_units(from).front();
     debug("SideController::ai_blob_transport() %d", to_go->m_units_free);
 
-    Hex *landing_hex = to.hexes.front();
+    Hex *landing_hex = ai.island_hexes(to).front();
     m_map->m_moving_units = to_go->m_units_free;
-    map->move_or_attack(to_go, landing_hex);
-    game->controller()->m_carriers -= 1;
+    m_map->move_or_attack(to_go, landing_hex);
+    m_carriers -= 1;
     ai.actions.push_back(AIAction(MapAction::MovingUnits, to_go, landing_hex, m_map->m_moving_units));
 }
 
-// build harvesters on good spots
-// TODO best spots instead of good spots
+// build harvesters where they take the most levels without overlapping
 void SideController::ai_blob_build_harvesters(ai_data &ai, Blob& blob) {
-    if(blob.harvesters.size() >= 2) { return; }
-
-    for(auto&& h : blob.all_hexes) {
-        if(game->controller()->get_resources() > 10) {
-            if(not building_nearby(h)) {
-                m_map->build_harvester(h);
-                game->controller_pay(10);
-                ai.actions.push_back(AIAction(MapAction::BuildHarvester, h, NULL, 0));
-            }
+    if(blob.num_harvesters >= 2) { return; }
+    if(ai.harvester_planner == NULL) { return; }
+
+    // the other blobs may have built since analyze()
+    ai.sync(m_map, m_side);
+
+    ai.sites.clear();
+    for(auto&& h : ai.blob_hexes(blob)) {
+        if(h->m_contains_harvester == false and
+           h->m_contains_armory == false and
+           h->m_contains_cannon == false and
+           ai.under_cannon_fire(h) == false) {
+            ai.sites.push_back(h->m_index);
         }
     }
+
+    int picks[2];
+    int max_sites = min(2 - blob.num_harvesters, get_resources() / harvester_cost);
+    int n = ai.harvester_planner->solve(ai.sites.data(), ai.sites.size(), max_sites, picks);
+
+    for(int i = 0; i < n; i++) {
+        Hex *h = m_map->m_hexes[picks[i]];
+        m_map->build_harvester(h);
+        pay(harvester_cost);
+        ai.actions.push_back(AIAction(MapAction::BuildHarvester, h, NULL, 0));
+    }
+}
+
+void sort_by_levels(Hex **begin, Hex **end) {
+    // ties by index, so the order doesn't depend on the sort
+    sort(begin, end, [](Hex *h1, Hex *h2) {
+            if(h1->m_level != h2->m_level) return h1->m_level > h2->m_level;
+            return h1->m_index < h2->m_index; });
 }
 
 void sort_by_levels(vector<Hex *>& hs) {
-    sort(hs.begin(), hs.end(), [](Hex *h1, Hex *h2) {
-            return h1->m_level > h2->m_level; });
+    sort_by_levels(hs.data(), hs.data() + hs.size());
 }
 
 void SideController::ai_blob_build_armories(ai_data &ai, Blob& blob) {
-    if(not blob.armories.empty()) { return; }
-    if(game->controller()->get_resources() < 35) { return; }
+    if(blob.num_armories > 0) { return; }
+    if(get_resources() < 35) { return; }
     debug("SideController::ai_blob_build_armories()");
     // try to find a good spot that doesn't neighbor harvesters
     bool built = false;
-    sort_by_levels(blob.all_hexes);
-    for(auto&& h : blob.all_hexes) {
+    ai_range<Hex *> hexes = ai.blob_hexes(blob);
+    sort_by_levels(hexes.begin(), hexes.end());
+    for(auto&& h : hexes) {
         if(built == true) { break; }
-        if(game->controller()->get_resources() < 35) { break; }
+        if(get_resources() < 35) { break; }
 
-        bool suitable = harvester_nearby(h) == false;
+        bool suitable = harvester_nearby(h) == false and ai.enemy_stronger(h) == false;
 
         if(suitable == true) {
-            if(game->controller()->get_resources() >= 35) {
+            if(get_resources() >= 35) {
                 m_map->build_armory(h);
-                game->controller_pay(35);
+                pay(35);
                 ai.actions.push_back(AIAction(MapAction::BuildArmory, h, NULL, -1));
                 built = true;
             }
@@ -862,7 +1277,7 @@ void SideController::ai_blob_build_armories(ai_data &ai, Blob& blob) {
     }
     // // build one anyway
     // if(not built) {
-    //     for(auto&& h : blob.all_hexes) {
+    //     for(auto&& h : ai.blob_hexes(blob)) {
     //         if(h->m_level < 3) { continue; }
     //         if(built == true) { break; }
     //         if(game->controller_resources() >= 35) {
@@ -877,7 +1292,7 @@ void SideController::ai_blob_build_armories(ai_data &ai, Blob& blob) {
 
 // expand into neutral territory with 1 unit
 void SideController::ai_blob_expand(ai_data &ai, Blob& blob) {
-    for(auto&& h : blob.all_hexes) {
+    for(auto&& h : ai.blob_hexes(blob)) {
         if(h->m_units_free >= 1) {
             for(auto&& neighbor : m_map->neighbors(h)) {
                 if(neighbor->alive() and neighbor->is_side(Side::Neutral) and
@@ -893,17 +1308,20 @@ void SideController::ai_blob_expand(ai_data &ai, Blob& blob) {
 
 // moves units across the blob as far away from origin as possible
 void SideController::ai_blob_move_max(ai_data &ai, Blob& blob) {
-    for(auto&& h : blob.all_hexes) {
+    for(auto&& h : ai.blob_hexes(blob)) {
         if(h->m_units_free == 0)
             continue;
 
-        vector<Hex *> allowed_moves = m_map->BFS(h, 4);
+        int n = m_map->legal_moves(this, ai.moves.data(), ai.moves.size(),
+                                   action_mask(MapAction::MovingUnits), h->m_index);
 
         float dist = -1;
         Hex *most_distant = NULL;
-        for(auto&& am : allowed_moves) {
+        for(int i = 0; i < n; i++) {
+            Hex *am = m_map->m_hexes[ai.moves[i].m_dst];
             if(m_map->hex_distance(h, am) > dist) {
-                if(am->m_level != 1 and harvester_nearby(am) == false) {
+                if(am->m_level != 1 and harvester_nearby(am) == false and
+                   ai.under_cannon_fire(am) == false) {
                     dist = m_map->hex_distance(h, am);
                     most_distant = am;
                 }
@@ -918,13 +1336,18 @@ void SideController::ai_blob_move_max(ai_data &ai, Blob& blob) {
     }
 }
 
-static Hex *furthest_along_path(HexMap *m, Hex *from, vector<Hex *>& path) {
-    vector<Hex *> allowed_moves = m->BFS(from, 4);
+static Hex *furthest_along_path(SideController *s, ai_data& ai, Hex *from,
+                                vector<Hex *>& path) {
+    int n = s->m_map->legal_moves(s, ai.moves.data(), ai.moves.size(),
+                                  action_mask(MapAction::MovingUnits), from->m_index);
     Hex *next = path.front();
     // find the furthest along the path we can move this turn
     for(auto it = path.rbegin(); it != path.rend(); ++it) {
-        if(find(allowed_moves.begin(), allowed_moves.end(), *it)
-           != allowed_moves.end()) {
+        bool allowed = false;
+        for(int i = 0; i < n and allowed == false; i++) {
+            allowed = ai.moves[i].m_dst == (*it)->m_index;
+        }
+        if(allowed == true) {
             next = *it;
             break;
         }
@@ -935,10 +1358,10 @@ static Hex *furthest_along_path(HexMap *m, Hex *from, vector<Hex *>& path) {
 // attack of the blobs
 void SideController::ai_blob_attack_blob(ai_data &ai, Blob& attacker, Blob& other) {
     if(other.free_units + other.moved_units >= attacker.free_units + attacker.moved_units) {
-        for(auto&& arm : attacker.armories) {
-            if(game->controller()->get_resources() >= 8) {
+        for(auto&& arm : ai.blob_armories(attacker)) {
+            if(get_resources() >= 8) {
                 arm->m_units_moved += 1;
-                game->controller_pay(8);
+                pay(8);
                 ai.actions.push_back(AIAction(MapAction::BuildWalker, arm, NULL, 1));
             }
         }
@@ -947,19 +1370,20 @@ void SideController::ai_blob_attack_blob(ai_data &ai, Blob& attacker, Blob& othe
     }
 
     vector<Hex *> my_units;
-    for(auto&& h : attacker.all_hexes) {
+    for(auto&& h : ai.blob_hexes(attacker)) {
         if(h->m_units_free > 0) my_units.push_back(h);
     }
 
+    ai_range<Hex *> targets = ai.blob_hexes(other);
     for(auto&& unit : my_units) {
         sort_by_levels(my_units);
-        Hex *to = m_map->nearest(unit, other.all_hexes);
+        Hex *to = m_map->nearest(unit, targets.begin(), targets.end());
         vector<Hex *> path = m_map->pathfind(unit, to);
         if(path.empty() == true) {
             debug("no path from %p to %p", unit, to);
             continue;
         }
-        Hex *next = furthest_along_path(m_map, unit, path);
+        Hex *next = furthest_along_path(this, ai, unit, path);
         m_map->m_moving_units = unit->m_units_free;
         m_map->move_or_attack(unit, next);
         ai.actions.push_back(AIAction(MapAction::MovingUnits, unit, next, m_map->m_moving_units));
@@ -969,7 +1393,7 @@ void SideController::ai_blob_attack_blob(ai_data &ai, Blob& attacker, Blob& othe
 // attack of the blobs
 void SideController::ai_blob_move_to(ai_data &ai, Blob& blob, Hex *to) {
     vector<Hex *> my_units;
-    for(auto&& h : blob.all_hexes) {
+    for(auto&& h : ai.blob_hexes(blob)) {
         if(h->m_units_free > 0) my_units.push_back(h);
     }
 
@@ -979,7 +1403,7 @@ void SideController::ai_blob_move_to(ai_data &ai, Blob& blob, Hex *to) {
             debug("no path from %p to %p", unit, to);
             continue;
         }
-        Hex *next = furthest_along_path(m_map, unit, path);
+        Hex *next = furthest_along_path(this, ai, unit, path);
         m_map->m_moving_units = unit->m_units_free;
         m_map->move_or_attack(unit, next);
         ai.actions.push_back(AIAction(MapAction::MovingUnits, unit, next, m_map->m_moving_units));
@@ -987,16 +1411,16 @@ void SideController::ai_blob_move_to(ai_data &ai, Blob& blob, Hex *to) {
 }
 
 __attribute__ ((unused))
-static bool reachable(HexMap *m, Blob &from, Blob &to) {
-    return not m->pathfind(from.all_hexes.front(),
-                           to.all_hexes.front()).empty();
+static bool reachable(HexMap *m, ai_data& ai, Blob &from, Blob &to) {
+    return not m->pathfind(ai.blob_hexes(from).front(),
+                           ai.blob_hexes(to).front()).empty();
 }
 
 __attribute__ ((unused))
-static Hex *hex_with_most_free_units(Blob &b) {
+static Hex *hex_with_most_free_units(ai_data& ai, Blob &b) {
     int most = 0;
     Hex *hex = NULL;
-    for(auto&& h : b.all_hexes) {
+    for(auto&& h : ai.blob_hexes(b)) {
         if(h->m_units_free > most) {
             hex = h;
             most = h->m_units_free;
@@ -1005,132 +1429,786 @@ static Hex *hex_with_most_free_units(Blob &b) {
     return hex;
 }
 
-void ai_data::analyze(HexMap *m) {
-    all_my_blobs.clear();
-    all_enemy_blobs.clear();
-    all_islands.clear();
+bool ai_data::under_cannon_fire(Hex *h) {
+    return influence != NULL and influence->cannon_threat(h->m_index) > 0;
+}
+
+bool ai_data::enemy_stronger(Hex *h) {
+    return influence != NULL and influence->balance(h->m_index) > 0;
+}
+
+// labels the alive hexes connected to from with value. Without
+// ignore_sides only through hexes of from's side
+void ai_data::flood(HexMap *m, int from, vector<int>& label, int value, bool ignore_sides) {
+    const Side side = m->m_hexes[from]->m_side;
+
+    m_queue.clear();
+    m_queue.push_back(from);
+    label[from] = value;
+
+    for(size_t qi = 0; qi < m_queue.size(); qi++) {
+        for(auto&& n : m->m_neighbors[m_queue[qi]]) {
+            if(n->alive() and label[n->m_index] == -1 and
+               (ignore_sides == true or n->m_side == side)) {
+                label[n->m_index] = value;
+                m_queue.push_back(n->m_index);
+            }
+        }
+    }
+}
+
+void ai_data::analyze(HexMap *m, Side side) {
+    AIProfTimer timer(AI_PROF_ANALYZE);
+    const int n = m->m_hexes.size();
+
+    // enough for any split of the map, so after the first call the
+    // vectors don't grow
+    hexes.reserve(n);
+    units.reserve(n);
+    armories.reserve(n);
+    blobs.reserve(n);
+    islands.reserve(n);
+    contested_islands.reserve(n);
+    islands_with_me.reserve(n);
+    islands_with_enemies.reserve(n);
+    islands_with_me_only.reserve(n);
+    islands_with_enemy_only.reserve(n);
+    islands_with_neutral_only.reserve(n);
+    m_queue.reserve(n);
+    m_by_island.reserve(n);
+    m_island_start.reserve(n + 1);
+
+    hexes.clear();
+    units.clear();
+    armories.clear();
+    blobs.clear();
+    islands.clear();
     contested_islands.clear();
     islands_with_me.clear();
     islands_with_enemies.clear();
     islands_with_me_only.clear();
     islands_with_enemy_only.clear();
     islands_with_neutral_only.clear();
+    m_island_of.assign(n, -1);
+    m_blob_of.assign(n, -1);
+
+    // islands, numbered in map order
+    int num_islands = 0;
+    for(auto&& h : m->m_hexes) {
+        if(h->alive() == true and m_island_of[h->m_index] == -1)
+            flood(m, h->m_index, m_island_of, num_islands++, true);
+    }
+
+    // hexes sorted by island, in map order
+    m_island_start.assign(num_islands + 1, 0);
+    for(auto&& h : m->m_hexes) {
+        if(h->alive() == true) m_island_start[m_island_of[h->m_index] + 1]++;
+    }
+    for(int i = 0; i < num_islands; i++) {
+        m_island_start[i + 1] += m_island_start[i];
+    }
+    m_by_island.resize(m_island_start[num_islands]);
+    for(auto&& h : m->m_hexes) {
+        if(h->alive() == true) m_by_island[m_island_start[m_island_of[h->m_index]]++] = h->m_index;
+    }
+    for(int i = num_islands; i > 0; i--) {
+        m_island_start[i] = m_island_start[i - 1];
+    }
+    m_island_start[0] = 0;
+
+    // blobs, numbered by island and then in map order, so each island's
+    // blobs are next to each other
+    for(int i = 0; i < num_islands; i++) {
+        island isl;
+        isl.level_sum = 0;
+        isl.first_blob = blobs.size();
+        isl.num_my_blobs = 0;
+        isl.num_enemy_blobs = 0;
+        isl.first_unit = units.size();
+
+        for(int k = m_island_start[i]; k < m_island_start[i + 1]; k++) {
+            const int hi = m_by_island[k];
+            Hex *h = m->m_hexes[hi];
+            isl.level_sum += h->m_level;
+            if(h->m_units_free > 0) units.push_back(h);
+
+            if(m_blob_of[hi] != -1)
+                continue;
 
-    vector<vector<Hex *>> islands_hxs = m->islands();
+            Blob b;
+            b.side = h->m_side;
+            b.island = i;
+            b.level_sum = 0;
+            b.num_hexes = 0;
+            b.num_armories = 0;
+            b.num_harvesters = 0;
+            b.num_cannons = 0;
+            b.free_units = 0;
+            b.moved_units = 0;
+            if(b.side == side) isl.num_my_blobs++;
+            else if(b.side != Side::Neutral) isl.num_enemy_blobs++;
+
+            flood(m, hi, m_blob_of, blobs.size(), false);
+            blobs.push_back(b);
+        }
 
-    for(auto&& island_hxs : islands_hxs) {
-        island i;
-        i.hexes = island_hxs;
-        i.level_sum = 0;
+        isl.num_blobs = blobs.size() - isl.first_blob;
+        isl.num_units = units.size() - isl.first_unit;
+        islands.push_back(isl);
+    }
 
-        for(auto&& h : i.hexes) {
-            i.level_sum += h->m_level;
-            if(h->m_units_free > 0) i.units.push_back(h);
+    // hexes sorted by blob, in map order
+    for(auto&& h : m->m_hexes) {
+        if(h->alive() == true) blobs[m_blob_of[h->m_index]].num_hexes++;
+    }
+    int first = 0;
+    for(auto&& b : blobs) {
+        b.first_hex = first;
+        first += b.num_hexes;
+        b.num_hexes = 0;
+    }
+    hexes.resize(first);
+    for(auto&& h : m->m_hexes) {
+        if(h->alive() == false)
+            continue;
+        Blob& b = blobs[m_blob_of[h->m_index]];
+        hexes[b.first_hex + b.num_hexes++] = h;
+    }
+
+    for(auto&& b : blobs) {
+        b.first_armory = armories.size();
+        for(auto&& h : blob_hexes(b)) {
+            b.level_sum += h->m_level;
+            if(h->m_contains_harvester == true) { b.num_harvesters++; }
+            if(h->m_contains_cannon == true) { b.num_cannons++; }
+            if(h->m_contains_armory == true) { armories.push_back(h); }
+            b.free_units += h->m_units_free;
+            b.moved_units += h->m_units_moved;
         }
+        b.num_armories = armories.size() - b.first_armory;
+        b.print();
+    }
 
-        vector<vector<Hex *>> clusters = find_clusters(m, island_hxs);
+    for(int i = 0; i < num_islands; i++) {
+        island& isl = islands[i];
+        const Blob& first_blob = blobs[isl.first_blob];
+        const Blob& last_blob = blobs[isl.first_blob + isl.num_blobs - 1];
+        isl.first_hex = first_blob.first_hex;
+        isl.num_hexes = last_blob.first_hex + last_blob.num_hexes - first_blob.first_hex;
 
-        for(auto&& cluster : clusters) {
-            Blob b = blob_analyze(cluster);
-            b.print();
-            if(b.side == game->side()) {
-                all_my_blobs.push_back(b);
-                i.my_blobs.push_back(b);
-            }
-            else if(b.side != Side::Neutral) {
-                all_enemy_blobs.push_back(b);
-                i.enemy_blobs.push_back(b);
-            } else { // neutral
-                i.neutral_blobs.push_back(b);
-            }
-        }
-        if(i.my_blobs.empty() == false) {
-            islands_with_me.push_back(i);
-        }
-        if(i.enemy_blobs.empty() == false) {
-            islands_with_enemies.push_back(i);
-        }
-        if(i.enemy_blobs.empty()) islands_with_me_only.push_back(i);
-        if(i.my_blobs.empty()) islands_with_enemy_only.push_back(i);
-        if(i.enemy_blobs.empty() and i.my_blobs.empty()) {
-            islands_with_neutral_only.push_back(i);
-        }
-        if(i.enemy_blobs.empty() == false and i.my_blobs.empty() == false) {
-            contested_islands.push_back(i);
-        }
+        const bool me = isl.num_my_blobs > 0;
+        const bool enemies = isl.num_enemy_blobs > 0;
+        if(me == true) islands_with_me.push_back(i);
+        if(enemies == true) islands_with_enemies.push_back(i);
+        if(enemies == false) islands_with_me_only.push_back(i);
+        if(me == false) islands_with_enemy_only.push_back(i);
+        if(enemies == false and me == false) islands_with_neutral_only.push_back(i);
+        if(enemies == true and me == true) contested_islands.push_back(i);
+    }
 
-        all_islands.push_back(i);
+    sync(m, side);
+}
+
+void ai_data::sync(HexMap *m, Side side) {
+    if(m->m_topology == NULL)
+        return;
+
+    if(m_board == NULL) {
+        m_board.reset(new Board(m->m_topology.get()));
+        influence.reset(new InfluenceMap(m->m_topology.get()));
+        harvester_planner.reset(new HarvesterPlanner(m->m_topology.get()));
+        sites.reserve(m->m_hexes.size());
     }
+    m->to_board(*m_board);
+    influence->update(*m_board, side);
+    harvester_planner->update(*m_board, side);
 }
 
-vector<AIAction> SideController::do_AI(void) {
-    // save the state before, do the ai while saving individual actions, undo the map, then replay it slowly
-    m_map->store_current_state();
+// the per island AI phases
+enum {
+    AI_PHASE_EXPAND,
+    AI_PHASE_HARVESTERS,
+    AI_PHASE_ARMORIES,
+    AI_PHASE_ATTACK,
+    AI_NUM_PHASES,
+};
 
-    ai_data ai;
-    ai.analyze(m_map);
+void SideController::ai_island_phase(ai_data& ai, int i, int phase) {
+    static const AIProfPhase prof_phase[AI_NUM_PHASES] = {
+        AI_PROF_EXPAND, AI_PROF_HARVESTERS, AI_PROF_ARMORIES, AI_PROF_ATTACK,
+    };
+    AIProfTimer timer(prof_phase[phase]);
+    ai_range<Blob> blobs = ai.island_blobs(ai.islands[i]);
 
-    for(auto&& island : ai.islands_with_me) {
-        for(auto&& b : island.my_blobs) {
-            ai_blob_expand(ai, b);
+    if(phase == AI_PHASE_ATTACK) {
+        if(ai.islands[i].num_enemy_blobs == 0)
+            return;
+        Blob *enemy = blobs.begin();
+        while(enemy->side == m_side or enemy->side == Side::Neutral) enemy++;
+
+        for(auto&& my_blob : blobs) {
+            if(my_blob.side == m_side) ai_blob_attack_blob(ai, my_blob, *enemy);
         }
+        return;
     }
-    for(auto&& island : ai.islands_with_me) {
-        for(auto&& b : island.my_blobs) {
-            ai_blob_build_harvesters(ai, b);
-        }
+
+    for(auto&& b : blobs) {
+        if(b.side != m_side)
+            continue;
+        if(phase == AI_PHASE_EXPAND) ai_blob_expand(ai, b);
+        else if(phase == AI_PHASE_HARVESTERS) ai_blob_build_harvesters(ai, b);
+        else if(phase == AI_PHASE_ARMORIES) ai_blob_build_armories(ai, b);
     }
-    for(auto&& island : ai.islands_with_me) {
-        for(auto&& b : island.my_blobs) {
-            ai_blob_build_armories(ai, b);
+}
+
+// does m, planned on a copy of m_map, for real. Returns false if it
+// isn't possible anymore
+bool SideController::ai_commit(ai_data& ai, const Move& m) {
+    Hex *src = m.m_src == -1 ? NULL : m_map->m_hexes[m.m_src];
+    Hex *dst = m.m_dst == -1 ? NULL : m_map->m_hexes[m.m_dst];
+
+    switch(m.m_act) {
+    case MapAction::MovingUnits:
+        if(src->m_side != m_side or src->m_units_free < 1)
+            return false;
+        m_map->m_moving_units = m.m_amount;
+        m_map->move_or_attack(src, dst);
+        break;
+    case MapAction::BuildHarvester:
+        if(src->m_contains_harvester == true or get_resources() < harvester_cost)
+            return false;
+        m_map->build_harvester(src);
+        pay(harvester_cost);
+        break;
+    case MapAction::BuildArmory:
+        if(src->m_contains_armory == true or get_resources() < armory_cost)
+            return false;
+        m_map->build_armory(src);
+        pay(armory_cost);
+        break;
+    case MapAction::BuildWalker:
+        if(src->m_contains_armory == false or get_resources() < walker_cost * m.m_amount)
+            return false;
+        src->m_units_moved += m.m_amount;
+        pay(walker_cost * m.m_amount);
+        break;
+    default:
+        fatal_error("SideController::ai_commit(): unexpected %s",
+                    map_action_to_string(m.m_act));
+    }
+
+    ai.actions.push_back(AIAction(m.m_act, src, dst, m.m_amount));
+    return true;
+}
+
+/*
+  The first phases only look at one island at a time, and islands only
+  share the resources. Each island is planned by a shadow controller
+  that has all of the resources, on the worker pool. Every worker copies
+  and analyzes the map once and plans its share of the islands on that
+  copy: a plan only touches its own island's hexes, so it doesn't see
+  the other plans. The plans are then done on m_map phase by phase in
+  island order, skipping what can't be paid for anymore, so the result
+  doesn't depend on the number of threads.
+ */
+void SideController::ai_plan_islands(ai_data& ai) {
+    struct Plan {
+        vector<Move> m_moves;
+        int m_phase_end[AI_NUM_PHASES];
+    };
+
+    const int n = ai.islands_with_me.size();
+    vector<Plan> plans(n);
+    AIProfile *prof = ai_prof;
+
+    const int workers = ai_pool == NULL ? 1 : min(n, ai_pool->size());
+
+    // plans islands w, w + workers, ...
+    auto plan_islands = [&](int w) {
+        // the workers report to the same profile
+        AIProfBind bind(prof);
+        HexMap *view = m_map->clone();
+
+        // the copy is split up the same way as m_map
+        ai_data local;
+        local.analyze(view, m_side);
+
+        for(int k = w; k < n; k += workers) {
+            SideController sc = *this;
+            sc.m_map = view;
+            sc.m_shadow = true;
+            local.actions.clear();
+
+            Plan& p = plans[k];
+            for(int phase = 0; phase < AI_NUM_PHASES; phase++) {
+                if(sc.ai_cancelled() == false)
+                    sc.ai_island_phase(local, ai.islands_with_me[k], phase);
+                p.m_phase_end[phase] = local.actions.size();
+            }
+            for(auto&& a : local.actions) {
+                p.m_moves.push_back({ a.m_act,
+                            a.m_src == NULL ? -1 : a.m_src->m_index,
+                            a.m_dst == NULL ? -1 : a.m_dst->m_index,
+                            a.m_amount });
+            }
         }
+        delete view;
+    };
+
+    if(workers > 1) {
+        ai_pool->run(workers, plan_islands);
+    } else if(n > 0) {
+        plan_islands(0);
     }
-    for(auto&& island : ai.contested_islands) {
-        for(auto&& my_blob : island.my_blobs) {
-            ai_blob_attack_blob(ai, my_blob, island.enemy_blobs.front());
+
+    int skipped = 0;
+    for(int phase = 0; phase < AI_NUM_PHASES; phase++) {
+        for(auto&& p : plans) {
+            int first = phase == 0 ? 0 : p.m_phase_end[phase - 1];
+            for(int i = first; i < p.m_phase_end[phase]; i++) {
+                if(ai_commit(ai, p.m_moves[i]) == false) skipped++;
+            }
         }
     }
+    debug("SideController::ai_plan_islands(): %d islands, %d actions, %d skipped",
+          n, ai.actions.size(), skipped);
+}
 
-    ai.analyze(m_map);
+// runs the AI on m_map, leaving the map in the state after all the
+// actions in ai.actions. Only touches m_map and this controller, so it
+// can also run on a cloned map with a shadow controller
+void SideController::ai_plan(ai_data& ai) {
+    if(m_engine == AIEngine::MCTS) {
+        ai_plan_mcts(ai);
+        return;
+    }
+
+    ai.analyze(m_map, m_side);
+    ai_plan_islands(ai);
+    if(ai_cancelled() == true)
+        return;
+    ai.analyze(m_map, m_side);
 
     // handle lonely blobs
-    for(auto&& island : ai.islands_with_me_only) {
-        if(island.units.size() == 1) {
+    AIProfTimer timer(AI_PROF_TRANSPORT);
+    for(auto&& i : ai.islands_with_me_only) {
+        if(ai_cancelled() == true)
+            break;
+        island& island = ai.islands[i];
+        if(island.num_units == 1) {
             // they're all together, so let's transport them somewhere else
 
             // buy a transport
             ai_buy_transport(ai);
 
-            if(game->controller()->m_carriers < 1)
+            if(m_carriers < 1)
                 break;
 
             if(ai.islands_with_enemy_only.size() >= 1) {
                 ai_blob_transport(ai,
                                   island,
-                                  ai.islands_with_enemy_only.front());
+                                  ai.islands[ai.islands_with_enemy_only.front()]);
             }
             else if(ai.islands_with_neutral_only.size() >= 1) {
                 ai_blob_transport(ai,
                                   island,
-                                  ai.islands_with_neutral_only.front());
+                                  ai.islands[ai.islands_with_neutral_only.front()]);
             }
         }
         else {
-            // group them up.
-            sort_by_levels(island.hexes);
-            for(auto&& blob : island.my_blobs) {
-                ai_blob_move_to(ai, blob, island.hexes.front());
+            // group them up. The island's hexes are sorted by blob, so
+            // look for the highest one instead of sorting them
+            ai_range<Hex *> hexes = ai.island_hexes(island);
+            Hex *top = *max_element(hexes.begin(), hexes.end(), [](Hex *h1, Hex *h2) {
+                    return h1->m_level < h2->m_level; });
+            for(auto&& blob : ai.island_blobs(island)) {
+                if(blob.side == m_side) ai_blob_move_to(ai, blob, top);
             }
         }
     }
+}
+
+// searches on a Board copy of the map, doesn't change m_map
+void SideController::ai_plan_mcts(ai_data& ai) {
+    AIProfTimer timer(AI_PROF_SEARCH);
+    const BoardTopology *topo = m_map->m_topology.get();
+    assert(topo);
+
+    Board b(topo);
+    m_map->to_board(b);
+    b.m_turn = m_side;
+    b.m_resources[(int)m_side] = get_resources();
+    b.m_carriers[(int)m_side] = m_carriers;
+    b.m_resources[(int)b.other_side()] = ai.enemy_resources;
+    b.m_carriers[(int)b.other_side()] = ai.enemy_carriers;
+
+    const AIDifficultyProfile& d = cfg.ai_difficulty[m_difficulty];
+    MCTSParams params;
+    params.time_budget = d.time_budget_ms / 1000.0;
+    params.iterations = d.iterations;
+    params.playout_turns = d.playout_turns;
+    params.cancel = m_cancel;
+    vector<Move> moves;
+    if(m_book != NULL and m_book->lookup(b.hash(), moves) == true) {
+        // the map's topology could have changed since the book was made
+        Board check(topo);
+        check.copy_from(b);
+        bool legal = true;
+        for(auto&& m : moves) {
+            if(check.is_legal(m) == false) {
+                legal = false;
+                break;
+            }
+            check.apply(m);
+        }
+        if(legal == true) {
+            ai_prof_count(AI_PROF_BOOK_HITS);
+            info("SideController::ai_plan_mcts(): %d moves from the book", moves.size());
+            ai_commit_moves(ai, moves);
+            return;
+        }
+        debug("SideController::ai_plan_mcts(): book moves aren't legal");
+    }
+    else if(m_book != NULL) {
+        debug("SideController::ai_plan_mcts(): position isn't in the book");
+    }
+
+    MCTS mcts(topo, params, m_seed ^ b.hash(), ai_pool, ai_tt);
+    mcts.play_turn(b, moves);
+    ai_prof_count(AI_PROF_MCTS_PLAYOUTS, mcts.m_playouts);
+    ai_prof_count(AI_PROF_TT_PROBES, mcts.m_tt_probes);
+    ai_prof_count(AI_PROF_TT_HITS, mcts.m_tt_hits);
+
+    debug("SideController::ai_plan_mcts(): %ld playouts in %.3fs (%.0f/s) on %d threads, "
+          "transposition table hits %ld/%ld (%.1f%%)",
+          mcts.m_playouts, mcts.m_time, mcts.m_playouts / max(mcts.m_time, 0.001),
+          ai_pool->size(), mcts.m_tt_hits, mcts.m_tt_probes,
+          100.0 * mcts.m_tt_hits / max(mcts.m_tt_probes, 1L));
+
+    ai_commit_moves(ai, moves);
+}
+
+void SideController::ai_commit_moves(ai_data& ai, const vector<Move>& moves) {
+    for(auto&& m : moves) {
+        ai.actions.push_back(AIAction(m.m_act,
+                                      m.m_src == -1 ? NULL : m_map->m_hexes[m.m_src],
+                                      m.m_dst == -1 ? NULL : m_map->m_hexes[m.m_dst],
+                                      m.m_amount));
+    }
+}
+
+vector<AIAction> SideController::do_AI(SideController *enemy) {
+    AIProfile prof;
+    AIProfBind bind(&prof);
+    auto start = chrono::steady_clock::now();
+
+    // save the state before, do the ai while saving individual actions, undo the map, then replay it slowly
+    m_map->store_current_state();
+
+    ai_data ai;
+    ai.enemy_resources = enemy->get_resources();
+    ai.enemy_carriers = enemy->m_carriers;
+    ai_plan(ai);
+
+    m_map->undo();
+    debug("SideController::do_AI(): number of ai actions: %d", ai.actions.size());
+
+    chrono::duration<double> time = chrono::steady_clock::now() - start;
+    ai_last_profile = prof.result(game == NULL ? 0 : game->m_turn, (int)m_side,
+                                  ai.actions.size(), time.count());
+    ai_have_profile = true;
+    debug("SideController::do_AI(): %.3fs, %ld pathfinds (%ld nodes), %ld BFSs",
+          time.count(), ai_last_profile.m_counters[AI_PROF_PATHFIND_CALLS],
+          ai_last_profile.m_counters[AI_PROF_PATHFIND_NODES],
+          ai_last_profile.m_counters[AI_PROF_BFS_CALLS]);
+    if(cfg.ai_profile_file[0] != '\0')
+        ai_prof_append(cfg.ai_profile_file, ai_last_profile);
+
+    return ai.actions;
+}
+
+// what happens to a side's hexes and resources when its turn begins
+static void begin_turn(HexMap *m, SideController *s) {
+    m->harvest(s);
+    s->add_resources(4);
+    m->free_units(s->m_side);
+}
+
+static uint64_t ai_turn_key(HexMap *m, SideController *s, SideController *enemy) {
+    uint64_t key = m->hash();
+    key = hash_mix(key, s->get_resources());
+    key = hash_mix(key, s->m_carriers);
+    key = hash_mix(key, (uint64_t)s->m_side);
+    key = hash_mix(key, enemy->get_resources());
+    key = hash_mix(key, enemy->m_carriers);
+    return key;
+}
+
+/*
+  Speculative AI: while a human is playing, a worker thread plays the
+  next AI turn on a copy of the board. Every move the human makes
+  resubmits the board and cancels the older work. When the AI turn
+  actually begins, the result is used if it was computed from the same
+  board, otherwise the AI runs as normal.
+ */
+struct AISpeculation {
+    // actions refer to hexes by index so they can be moved between maps
+    struct Action {
+        MapAction m_act;
+        int m_src;
+        int m_dst;
+        int m_amount;
+    };
+
+    thread m_thread;
+    mutex m_mutex;
+    condition_variable m_cv;
+    bool m_quit;
+
+    // submitted board that the worker hasn't picked up yet
+    HexMap *m_job_map;
+    SideController m_job_sc;
+    SideController m_job_enemy;
+    unsigned m_job_gen;
+    uint64_t m_submitted_key;
+
+    bool m_busy;
+    unsigned m_gen;
+    // key of the board the worker is on, once it has begun the turn
+    uint64_t m_running_key;
+    // stops the worker's AI, see SideController::m_cancel
+    atomic<bool> m_cancel;
+
+    bool m_have_result;
+    unsigned m_result_gen;
+    uint64_t m_result_key;
+    vector<Action> m_result;
+    // what the worker spent on m_result
+    AITurnProfile m_result_profile;
+
+    int m_hits;
+    int m_misses;
+
+    AISpeculation();
+    ~AISpeculation();
+
+    void submit(HexMap *m, SideController *sc, SideController *enemy);
+    bool take(HexMap *m, SideController *sc, SideController *enemy,
+              vector<AIAction>& out);
+    void worker(void);
+};
+
+AISpeculation::AISpeculation() {
+    m_quit = false;
+    m_job_map = NULL;
+    m_job_gen = 0;
+    m_submitted_key = 0;
+    m_busy = false;
+    m_gen = 0;
+    m_running_key = 0;
+    m_cancel = false;
+    m_have_result = false;
+    m_result_gen = 0;
+    m_result_key = 0;
+    m_hits = 0;
+    m_misses = 0;
+    m_thread = thread(&AISpeculation::worker, this);
+}
+
+AISpeculation::~AISpeculation() {
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_quit = true;
+        m_cancel = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+    delete m_job_map;
+    debug("AISpeculation: hits: %d misses: %d", m_hits, m_misses);
+}
+
+// sc is the controller that will play the next turn
+void AISpeculation::submit(HexMap *m, SideController *sc, SideController *enemy) {
+    uint64_t key = ai_turn_key(m, sc, enemy);
+    if(key == m_submitted_key)
+        return;
+
+    HexMap *copy = m->clone();
+    {
+        lock_guard<mutex> lock(m_mutex);
+        delete m_job_map;
+        m_job_map = copy;
+        m_job_sc = *sc;
+        m_job_enemy = *enemy;
+        m_job_gen = ++m_gen;
+        m_submitted_key = key;
+        if(m_busy == true)
+            m_cancel = true;
+    }
+    m_cv.notify_all();
+}
+
+// called at the start of sc's turn, after begin_turn()
+bool AISpeculation::take(HexMap *m, SideController *sc, SideController *enemy,
+                         vector<AIAction>& out) {
+    uint64_t key = ai_turn_key(m, sc, enemy);
+
+    unique_lock<mutex> lock(m_mutex);
+    // a board that's still waiting is the newest one, so let it run,
+    // but don't wait for the worker to finish a different turn
+    m_cv.wait(lock, [this, key]{
+            if(m_busy == true and m_job_map == NULL and
+               m_running_key != 0 and m_running_key != key)
+                m_cancel = true;
+            return m_busy == false and m_job_map == NULL; });
+    m_submitted_key = 0;
+
+    if(m_have_result == false or m_result_gen != m_gen or m_result_key != key) {
+        m_misses++;
+        debug("AISpeculation::take(): miss");
+        return false;
+    }
+
+    m_hits++;
+    m_have_result = false;
+    out.clear();
+    for(auto&& a : m_result) {
+        out.push_back(AIAction(a.m_act,
+                               a.m_src == -1 ? NULL : m->m_hexes[a.m_src],
+                               a.m_dst == -1 ? NULL : m->m_hexes[a.m_dst],
+                               a.m_amount));
+    }
+    // the worker doesn't know which turn it was playing
+    m_result_profile.m_turn = game == NULL ? 0 : game->m_turn;
+    ai_last_profile = m_result_profile;
+    ai_have_profile = true;
+    lock.unlock();
+
+    debug("AISpeculation::take(): hit, %d actions", out.size());
+    if(cfg.ai_profile_file[0] != '\0')
+        ai_prof_append(cfg.ai_profile_file, ai_last_profile);
+    return true;
+}
+
+void AISpeculation::worker(void) {
+    for(;;) {
+        HexMap *m;
+        SideController sc;
+        SideController enemy;
+        unsigned gen;
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_cv.wait(lock, [this]{ return m_quit or m_job_map != NULL; });
+            if(m_quit == true)
+                return;
+            m = m_job_map;
+            sc = m_job_sc;
+            enemy = m_job_enemy;
+            gen = m_job_gen;
+            m_job_map = NULL;
+            m_busy = true;
+            m_running_key = 0;
+            m_cancel = false;
+        }
+
+        sc.m_map = m;
+        sc.m_shadow = true;
+        sc.m_cancel = &m_cancel;
+        begin_turn(m, &sc);
+        uint64_t key = ai_turn_key(m, &sc, &enemy);
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_running_key = key;
+        }
+        m_cv.notify_all();
+
+        AIProfile prof;
+        AIProfBind bind(&prof);
+        auto start = chrono::steady_clock::now();
+
+        ai_data ai;
+        ai.enemy_resources = enemy.get_resources();
+        ai.enemy_carriers = enemy.m_carriers;
+        sc.ai_plan(ai);
+
+        chrono::duration<double> time = chrono::steady_clock::now() - start;
+        AITurnProfile profile = prof.result(0, (int)sc.m_side, ai.actions.size(), time.count());
+
+        vector<Action> result;
+        for(auto&& a : ai.actions) {
+            result.push_back({ a.m_act,
+                        a.m_src == NULL ? -1 : a.m_src->m_index,
+                        a.m_dst == NULL ? -1 : a.m_dst->m_index,
+                        a.m_amount });
+        }
+        delete m;
+
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_busy = false;
+            // a newer board was submitted while we were busy, or the
+            // plan was cut short
+            if(gen == m_gen and m_cancel == false) {
+                m_have_result = true;
+                m_result_gen = gen;
+                m_result_key = key;
+                m_result.swap(result);
+                m_result_profile = profile;
+            }
+        }
+        m_cv.notify_all();
+    }
+}
+
+// start working on the next AI turn if a human is playing now
+static void ai_speculate(void) {
+    if(ai_spec == NULL or game == NULL)
+        return;
+    if(game->controller()->is_AI() == true)
+        return;
+    SideController *next = game->peek_next_controller();
+    if(next->is_AI() == false)
+        return;
+    ai_spec->submit(map, next, game->controller());
+}
+
+static void goto_mainmenu(void);
+static void record_move(MapAction act, Hex *src, Hex *dst = NULL, int amount = 0);
+
+// the hexes that can be on the screen this frame
+static vector<Hex *> visible_hexes;
+// scratch for hit_map_widget()
+static vector<Hex *> hexes_under_mouse;
+
+// scratch for draw_regions()
+static vector<HexMap::Region *> visible_regions;
+
+static void find_visible_hexes(void) {
+    visible_hexes.clear();
+    map->hexes_in(view_x, view_y,
+                  view_x + display_x / scale, view_y + display_y / scale,
+                  visible_hexes);
+}
+
+// the map's widgets come before its hexes, and of the hexes only the
+// ones near the mouse are worth trying
+static Widget *hit_map_widget(UI *ui) {
+    for(auto&& w : ui->widgets) {
+        if(w->m_type != WidgetType::Hex and w->m_visible == true and ui->is_hit(w) == true)
+            return w;
+    }
 
-    m_map->undo();
-    debug("SideController::do_AI(): number of ai actions: %d", ai.actions.size());
-    return ai.actions;
+    const float x = view_x + mouse_x / scale;
+    const float y = view_y + mouse_y / scale;
+    hexes_under_mouse.clear();
+    map->hexes_in(x, y, x, y, hexes_under_mouse);
+    for(auto&& h : hexes_under_mouse) {
+        if(h->m_visible == true and ui->is_hit(h) == true)
+            return h;
+    }
+    return NULL;
 }
 
-static void goto_mainmenu(void);
-
 struct MapUI : UI {
 private:
     MapAction m_current_action;
@@ -1138,35 +2216,52 @@ public:
     vector<AIAction> m_ai_acts;
     bool m_ai_replay;
     int m_ai_acts_stage;
-    int m_ai_play_time;
+    // where each batch of m_ai_acts ends. The actions in a batch touch
+    // different hexes, so they're animated together
+    vector<int> m_ai_batches;
+    int m_ai_batch;
+    double m_ai_batch_start;
+    double m_ai_batch_time;
     bool m_game_won;
     bool m_game_lost;
-    const int m_ai_play_delay = 15;
     bool m_draw_buttons;
     bool m_marked_hexes;
     float m_turn_anim;
+    bool m_draw_ai_profile;
+    // the hexes as of the last frame
+    MapLayer m_layer;
+    // scratch for legal_moves()
+    vector<Move> m_legal;
 
-    MapUI() {
+    MapUI() : m_legal(max_legal_moves) {
         m_current_action = MapAction::MovingUnits;
         m_ai_replay = false;
         m_ai_acts_stage = 0;
-        m_ai_play_time = 0;
+        m_ai_batch = 0;
+        m_ai_batch_start = 0;
+        m_ai_batch_time = 0;
         m_game_won = false;
         m_game_lost = false;
         m_draw_buttons = true;
         m_marked_hexes = false;
         m_turn_anim = 0;
+        m_draw_ai_profile = false;
     }
     ~MapUI() {
         for(auto&& w : widgets) delete w;
     }
 
+    Widget *hit_widget(void) override { return hit_map_widget(this); }
     void mouseDownEvent(void) override;
     void keyDownEvent(void) override {
         if(m_game_won or m_game_lost) {
             goto_mainmenu();
         } else {
             if(key == ALLEGRO_KEY_H) m_draw_buttons = !m_draw_buttons;
+            if(key == ALLEGRO_KEY_P) {
+                m_draw_ai_profile = !m_draw_ai_profile;
+                set_redraw();
+            }
             UI::keyDownEvent();
         }
     }
@@ -1188,21 +2283,50 @@ public:
 
     void ai_play(vector<AIAction> acts);
     bool ai_replay(void);
+    void ai_draw_batch(float t);
 
     void mark(vector<Hex *> hs) {
         if(hs.empty() == true) {
             m_marked_hexes = false;
             return;
         }
-        for(auto&& h : hs)
-            if(h->alive())
+        for(auto&& h : hs) {
+            if(h->alive()) {
                 h->m_marked = true;
+                map->restyle(h);
+            }
+        }
         m_marked_hexes = true;
     }
     void clear_mark(void) {
-        for(auto&& h : map->m_hexes) h->m_marked = false;
+        for(auto&& h : map->m_hexes) {
+            if(h->m_marked == true) {
+                h->m_marked = false;
+                map->restyle(h);
+            }
+        }
         m_marked_hexes = false;
     }
+
+    // current side's moves of type act, from the hex from if it's not
+    // NULL. The moves are in m_legal
+    int legal_moves(MapAction act, Hex *from = NULL) {
+        return map->legal_moves(game->controller(), m_legal.data(), m_legal.size(),
+                                action_mask(act), from == NULL ? -1 : from->m_index);
+    }
+    // marks the hexes that legal_moves() targets, returns how many
+    // moves there are
+    int mark_legal(MapAction act, Hex *from = NULL) {
+        int n = legal_moves(act, from);
+        for(int i = 0; i < n; i++) {
+            const Move& m = m_legal[i];
+            Hex *h = map->m_hexes[m.m_dst >= 0 ? m.m_dst : m.m_src];
+            h->m_marked = true;
+            map->restyle(h);
+        }
+        m_marked_hexes = n > 0;
+        return n;
+    }
 };
 
 static void center_view_on_hexes(vector<Hex *>& hexes) {
@@ -1245,6 +2369,7 @@ struct MapEditorUI : UI {
     void set_current_action(MapEditorAction act) {
         m_current_action = act;
     }
+    Widget *hit_widget(void) override { return hit_map_widget(this); }
     void mouseDownEvent(void);
     MapEditorAction get_current_action(void) {
         return m_current_action;
@@ -1254,8 +2379,18 @@ struct MapEditorUI : UI {
 
 void MapEditorUI::draw(void) {
     // draw normal hexes
-    for(auto&& h : map->m_hexes) {
-        h->draw_editor();
+    {
+        FrameProfTimer t(FRAME_HEXES);
+        find_visible_hexes();
+        frame_prof_count(FRAME_HEXES_DRAWN, visible_hexes.size());
+        for(auto&& h : visible_hexes) {
+            h->draw_editor(hex_batch);
+        }
+        hex_batch.draw();
+        for(auto&& h : visible_hexes) {
+            h->draw_editor_label(hex_labels);
+        }
+        hex_labels.draw();
     }
 
     for(auto&& w : widgets) {
@@ -1286,7 +2421,8 @@ void MapEditorUI::update(void) {
         set_redraw();
     }
 
-    float ds = 1.02;
+    // 1.02 a tick at the old fixed 30Hz, whatever the frame rate
+    float ds = pow(1.02, dt * 30);
     if(al_key_down(&keyboard_state, ALLEGRO_KEY_OPENBRACE)) {
         scale *= ds;
         set_redraw();
@@ -1345,20 +2481,81 @@ void MapEditorUI::MapHexSelected(Hex *h) {
     } else {
         info("MapEditorUI::MapHexSelected(): Unknown map editor action");
     }
+    map->restyle(h);
 }
 
 static bool marked_hexes(void) {
     return Map_UI->m_marked_hexes;
 }
 
+// ends a batch before an action that touches a hex that's already in it
+static void batch_actions(const vector<AIAction>& acts, vector<int>& batches) {
+    vector<Hex *> touched;
+    batches.clear();
+    for(int i = 0; i < (int)acts.size(); i++) {
+        const AIAction& a = acts[i];
+        bool conflict = false;
+        for(auto&& h : touched) {
+            if(h == a.m_src or h == a.m_dst) conflict = true;
+        }
+        if(conflict == true) {
+            batches.push_back(i);
+            touched.clear();
+        }
+        if(a.m_src != NULL) touched.push_back(a.m_src);
+        if(a.m_dst != NULL) touched.push_back(a.m_dst);
+    }
+    if(acts.empty() == false)
+        batches.push_back(acts.size());
+}
+
 void MapUI::ai_play(vector<AIAction> acts) {
     debug("MapUI::ai_play() %d", acts.size());
     m_ai_acts = acts;
     m_ai_acts_stage = 0;
     m_ai_replay = true;
+
+    batch_actions(m_ai_acts, m_ai_batches);
+    m_ai_batch = 0;
+    m_ai_batch_start = al_get_time();
+    // long turns play faster so they take at most ai_replay_max_ms
+    m_ai_batch_time = cfg.ai_replay_batch_ms / 1000.0;
+    if(m_ai_batches.empty() == false)
+        m_ai_batch_time = min(m_ai_batch_time,
+                              cfg.ai_replay_max_ms / 1000.0 / m_ai_batches.size());
+    debug("MapUI::ai_play(): %d batches, %.3fs each", m_ai_batches.size(), m_ai_batch_time);
+
     msg->add("AI turn. Press 's' to skip ahead.");
 }
 
+// the current batch, t from 0 to 1 through it. Units slide from where
+// they move from to where they move to, and new buildings get a ring
+void MapUI::ai_draw_batch(float t) {
+    if(m_ai_batch >= (int)m_ai_batches.size())
+        return;
+
+    const ALLEGRO_COLOR color = game->controller()->m_color;
+    for(int i = m_ai_acts_stage; i < m_ai_batches[m_ai_batch]; i++) {
+        const AIAction& a = m_ai_acts[i];
+        if(a.m_src == NULL)
+            continue;
+        const float x1 = vx(a.m_src->m_cx);
+        const float y1 = vy(a.m_src->m_cy);
+
+        if(a.m_dst != NULL) {
+            const float x2 = vx(a.m_dst->m_cx);
+            const float y2 = vy(a.m_dst->m_cy);
+            const float x = x1 + (x2 - x1) * t;
+            const float y = y1 + (y2 - y1) * t;
+            al_draw_line(x1, y1, x2, y2, colors.white, 2);
+            al_draw_filled_circle(x, y, 8 * scale, color);
+            al_draw_circle(x, y, 8 * scale, colors.white, 2);
+        } else {
+            al_draw_circle(x1, y1, a.m_src->m_r * scale * t, colors.white, 3);
+        }
+    }
+}
+
 bool MapUI::ai_replay(void) {
     debug("MapUI::ai_replay()");
     if(m_ai_acts.empty() == true or m_ai_acts_stage >= (int)m_ai_acts.size()) {
@@ -1370,32 +2567,48 @@ bool MapUI::ai_replay(void) {
 
     /* should these have checks? */
     if(a.m_act == MapAction::MovingUnits) {
+        vector<Hex *> bfs = map->BFS(a.m_src, 4);
+        if(find(bfs.begin(), bfs.end(), a.m_dst) == bfs.end()) {
+            game->controller()->m_carriers -= 1;
+        }
         map->m_moving_units = a.m_amount;
         map->move_or_attack(a.m_src, a.m_dst);
     }
     else if(a.m_act == MapAction::BuildHarvester) {
         map->build_harvester(a.m_src);
-        game->controller_pay(10);
+        game->controller_pay(harvester_cost);
     }
     else if(a.m_act == MapAction::DestroyHarvester) {
         map->destroy_harvester(a.m_src);
     }
     else if(a.m_act == MapAction::BuildCarrier) {
-        game->controller_pay(50);
+        game->controller_pay(carrier_cost);
         game->controller()->m_carriers += 1;
     }
     else if(a.m_act == MapAction::BuildArmory) {
-        game->controller_pay(35);
+        game->controller_pay(armory_cost);
         map->build_armory(a.m_src);
     }
     else if(a.m_act == MapAction::BuildWalker) {
-        game->controller_pay(8 * a.m_amount);
+        game->controller_pay(walker_cost * a.m_amount);
         a.m_src->m_units_moved += a.m_amount;
     }
+    else if(a.m_act == MapAction::BuildCannon) {
+        game->controller_pay(cannon_cost);
+        map->build_cannon(a.m_src);
+    }
+    else if(a.m_act == MapAction::AddAmmoToCannon) {
+        game->controller_pay(cannon_ammo_cost);
+        map->add_cannon_ammo(a.m_src);
+    }
+    else if(a.m_act == MapAction::FireCannon) {
+        map->fire_cannon(a.m_src, a.m_dst);
+    }
     else {
         fatal_error("MapUI::ai_replay(): not implemented yet: %d",
                     (int)a.m_act);
     }
+    record_move(a.m_act, a.m_src, a.m_dst, a.m_amount);
 
     m_ai_acts_stage++;
     return true;
@@ -1420,15 +2633,24 @@ struct MainMenuUI : UI {
 struct GameSetupUI : UI {
     Button *m_selected_map;
     Button *m_selected_player;
+    Button *m_selected_difficulty;
 
     vector<Button *> m_player_select_btns;
+    vector<Button *> m_difficulty_select_btns;
     vector<Button *> m_map_select_btns;
+    // by map button, NULL if there's none
+    vector<ALLEGRO_BITMAP *> m_map_previews;
 
     GameSetupUI();
     ~GameSetupUI() {
         for(auto&& w: m_map_select_btns) free((char*)w->m_name);
         for(auto&& w: widgets) delete w;
+        for(auto&& p : m_map_previews) if(p != NULL) al_destroy_bitmap(p);
     }
+
+    void draw(void) override;
+    // only Blue.MCTS has a difficulty
+    void show_difficulty(void);
 };
 
 static void new_game(GameType t);
@@ -1436,6 +2658,7 @@ static void btn_begin_cb(void);
 static void btn_editor_cb(void);
 static void btn_map_select_cb(void);
 static void btn_player_select_cb(void);
+static void btn_difficulty_select_cb(void);
 
 GameSetupUI::GameSetupUI() {
     DIR *dpdf;
@@ -1455,6 +2678,8 @@ GameSetupUI::GameSetupUI() {
     } else {
         fatal_error("GameSetupUI::GameSetupUI(): Couldn't open ./maps: ", strerror(errno));
     }
+    // readdir() order depends on the file system
+    sort(map_filenames.begin(), map_filenames.end());
 
     Button *btn_begin = new Button("Begin");
     btn_begin->setpos(display_x/2 - 40, display_y - 70,
@@ -1484,6 +2709,10 @@ GameSetupUI::GameSetupUI() {
             map_btns.push_back(btn_map);
             m_map_select_btns.push_back(btn_map);
 
+            // cached next to the map, see src/previewtool.cpp
+            string map_filename = "maps/" + map_name;
+            m_map_previews.push_back(load_map_preview(map_filename.c_str(), 400, 300));
+
             y += 35;
         }
 
@@ -1513,11 +2742,66 @@ GameSetupUI::GameSetupUI() {
     btn_blue_player_human->m_color = colors.blue;
     addWidget(btn_blue_player_human);
 
+    Button *btn_blue_player_mcts = new Button("Blue.MCTS");
+    xsize = 10 + al_get_text_width(g_font, "Blue.MCTS");
+    btn_blue_player_mcts->setpos(display_x - 200 - xsize, y + 70,
+                                 display_x - 200, y + 100);
+    btn_blue_player_mcts->onMouseDown = btn_player_select_cb;
+    btn_blue_player_mcts->set_offsets();
+    btn_blue_player_mcts->m_color = colors.blue;
+    addWidget(btn_blue_player_mcts);
+
     btn_blue_player_ai->m_pressed = true;
     btn_blue_player_ai->m_color = colors.blue_muted;
     m_selected_player = btn_blue_player_ai;
 
-    m_player_select_btns = { btn_blue_player_ai, btn_blue_player_human };
+    m_player_select_btns = { btn_blue_player_ai, btn_blue_player_human,
+                             btn_blue_player_mcts };
+
+    // how hard Blue.MCTS thinks, from game.conf
+    y += 150;
+    for(int d = 0; d < AI_NUM_DIFFICULTIES; d++) {
+        const char *name = ai_difficulty_names[d];
+        Button *btn = new Button(name);
+        xsize = 10 + al_get_text_width(g_font, name);
+        btn->setpos(display_x - 200 - xsize, y,
+                    display_x - 200, y + 30);
+        btn->onMouseDown = btn_difficulty_select_cb;
+        btn->set_offsets();
+        btn->m_color = colors.blue;
+        addWidget(btn);
+        m_difficulty_select_btns.push_back(btn);
+
+        if(d == cfg.ai_default_difficulty) {
+            btn->m_pressed = true;
+            btn->m_color = colors.blue_muted;
+            m_selected_difficulty = btn;
+        }
+        y += 35;
+    }
+    show_difficulty();
+}
+
+void GameSetupUI::show_difficulty(void) {
+    const bool mcts = strcmp(m_selected_player->m_name, "Blue.MCTS") == 0;
+    for(auto&& b : m_difficulty_select_btns) {
+        b->m_visible = mcts;
+    }
+}
+
+// the selected map's preview between the map and player buttons
+void GameSetupUI::draw(void) {
+    UI::draw();
+
+    for(size_t i = 0; i < m_map_select_btns.size(); i++) {
+        ALLEGRO_BITMAP *p = m_map_previews[i];
+        if(m_map_select_btns[i] != m_selected_map or p == NULL)
+            continue;
+        const float w = min(400, display_x / 3);
+        const float h = w * 3 / 4;
+        al_draw_scaled_bitmap(p, 0, 0, al_get_bitmap_width(p), al_get_bitmap_height(p),
+                              display_x / 2 - w / 2, 45, w, h, 0);
+    }
 }
 
 static void btn_map_select_cb(void) {
@@ -1548,6 +2832,22 @@ static void btn_player_select_cb(void) {
             b->m_color = colors.blue;
         }
     }
+    GameSetup_UI->show_difficulty();
+}
+
+static void btn_difficulty_select_cb(void) {
+    for(auto&& b : GameSetup_UI->m_difficulty_select_btns) {
+        if(b->m_pressed == true) {
+            GameSetup_UI->m_selected_difficulty = b;
+            b->m_color = colors.blue_muted;
+        }
+    }
+    for(auto&& b : GameSetup_UI->m_difficulty_select_btns) {
+        b->m_pressed = false;
+        if(b != GameSetup_UI->m_selected_difficulty) {
+            b->m_color = colors.blue;
+        }
+    }
 }
 
 static void btn_begin_cb(void) {
@@ -1559,31 +2859,22 @@ static void btn_editor_cb(void) {
 }
 
 static inline void draw_hex(float x, float y, float a, float zrot, float cr, float cg, float cb) {
-    constexpr static float s12 = sin(1.0/2.0);
-    constexpr static float sqrt3div2 = 0.5*sqrt(3);
-    constexpr static float verts[6][2] =
-        { { -0.5,         -sqrt3div2 },
-          {  0.5,         -sqrt3div2 },
-          {  0.5 + s12,    0 },
-          {  0.5,          sqrt3div2 },
-          { -0.5,          sqrt3div2 },
-          { -0.5 - s12,    0 }
-        };
-
     glPushMatrix();
 
     glTranslatef(x, y, 0);
     glRotatef(zrot, 0, 0, 1);
     glScalef(a, a, 0);
 
+    frame_prof_count(FRAME_DRAW_CALLS);
+
     glBegin(GL_POLYGON);
     glColor3f(cr, cg, cb);
-    glVertex3f(verts[0][0], verts[0][1], 0);
-    glVertex3f(verts[1][0], verts[1][1], 0);
-    glVertex3f(verts[2][0], verts[2][1], 0);
-    glVertex3f(verts[3][0], verts[3][1], 0);
-    glVertex3f(verts[4][0], verts[4][1], 0);
-    glVertex3f(verts[5][0], verts[5][1], 0);
+    glVertex3f(hex_verts[0][0], hex_verts[0][1], 0);
+    glVertex3f(hex_verts[1][0], hex_verts[1][1], 0);
+    glVertex3f(hex_verts[2][0], hex_verts[2][1], 0);
+    glVertex3f(hex_verts[3][0], hex_verts[3][1], 0);
+    glVertex3f(hex_verts[4][0], hex_verts[4][1], 0);
+    glVertex3f(hex_verts[5][0], hex_verts[5][1], 0);
     glEnd();
 
     glPopMatrix();
@@ -1700,6 +2991,7 @@ void MapUI::mouseDownEvent(void) {
     } else {
         UI::mouseDownEvent();
     }
+    ai_speculate();
 }
 
 void Widget::init(void) {
@@ -1737,13 +3029,22 @@ void HexMap::build_harvester(Hex *h) {
     h->m_contains_harvester = true;
 }
 
+void HexMap::dying(Hex *h) {
+    restyle(h);
+    // the AI's copies of the map aren't drawn
+    if(h->m_level == 0 and this == map and Map_UI != NULL)
+        Map_UI->animate(h);
+}
+
 void HexMap::destroy_harvester(Hex *h) {
-    for(auto&& n : map->neighbors(h)) {
+    for(auto&& n : neighbors(h)) {
         if(n->alive() == true) {
             n->harvest();
+            dying(n);
         }
     }
     h->harvest();
+    dying(h);
     h->m_contains_harvester = false;
 }
 
@@ -1766,12 +3067,13 @@ void HexMap::fire_cannon(Hex *from, Hex *to) {
     from->m_ammo = false;
     to->m_level -= 1;
     to->destroy_units(8);
+    dying(to);
 }
 
 bool HexMap::cannon_in_range(Hex *from, Hex *to) {
-    float dist = map->hex_distance(from, to);
+    float dist = hex_distance(from, to);
 
-    return dist > (0.4 + 2 * m_cannon_min_range) * from->m_circle_bb_radius and dist < (0.4 + 2 * m_cannon_max_range) * from->m_circle_bb_radius;
+    return dist > (0.4 + 2 * cannon_min_range) * from->m_circle_bb_radius and dist < (0.4 + 2 * cannon_max_range) * from->m_circle_bb_radius;
 }
 
 void HexMap::save(ostream &os) {
@@ -1823,31 +3125,9 @@ vector<vector<Hex *>> HexMap::islands(void) {
     return ret;
 }
 
-vector<vector<Hex *>> find_clusters(HexMap* m, vector<Hex *>& hexes) {
-    vector<bool> visited(hexes.size(), false);
-
-    vector<vector<Hex *>> ret;
-
-    for(auto&& h : hexes) {
-        if(h->alive() == true) {
-            if(visited[h->m_index] == false) {
-                visited[h->m_index] = true;
-                vector<Hex *> cl = m->BFS(h, 100, h->m_side, false, false);
-                for(auto&& c: cl) visited[c->m_index] = true;
-                ret.push_back(cl);
-            }
-        }
-    }
-
-    debug("clusters: %d", ret.size());
-    for(auto&& r : ret) debug("cluster size: %d", r.size());
-
-    return ret;
-}
-
-
 vector<Hex *> HexMap::pathfind(Hex *from, Hex *to) {
     debug("HexMap::pathfind from %p to %p", from, to);
+    ai_prof_count(AI_PROF_PATHFIND_CALLS);
     struct bfsdata {
         Hex *parent;
         bfsdata() { parent = NULL; }
@@ -1855,12 +3135,17 @@ vector<Hex *> HexMap::pathfind(Hex *from, Hex *to) {
 
     vector<bfsdata> hexdata(m_hexes.size());
 
-    deque<Hex *> q;
+    // from has no parent, so it can be queued twice, but no other hex
+    // is. The queue never grows past that
+    vector<Hex *> q;
+    q.reserve(m_hexes.size() + 1);
     q.push_back(from);
+    ai_prof_count(AI_PROF_ALLOCATIONS, 2);
 
-    while(not q.empty()) {
-        Hex *cur = q.front();
-        q.pop_front();
+    long expanded = 0;
+    for(size_t head = 0; head < q.size(); head++) {
+        Hex *cur = q[head];
+        expanded++;
         for(auto&& neighbor : neighbors(cur)) {
             bool not_visited = hexdata[neighbor->m_index].parent == NULL;
 
@@ -1870,23 +3155,28 @@ vector<Hex *> HexMap::pathfind(Hex *from, Hex *to) {
             }
         }
     }
+    ai_prof_count(AI_PROF_PATHFIND_NODES, expanded);
 
     if(hexdata[to->m_index].parent == NULL) { return {}; } // no path
 
-    vector<Hex *> ret;
+    int length = 0;
+    for(Hex *cur = to; cur != from; cur = hexdata[cur->m_index].parent) length++;
+
+    vector<Hex *> ret(length);
+    if(length > 0) ai_prof_count(AI_PROF_ALLOCATIONS);
     Hex *cur = to;
-    while(cur != from) {
-        ret.push_back(cur);
+    for(int i = length - 1; i >= 0; i--) {
+        ret[i] = cur;
         cur = hexdata[cur->m_index].parent;
     }
-    reverse(ret.begin(), ret.end());
     return ret;
 }
 
-Hex *HexMap::nearest(Hex *from, vector<Hex *> to) {
+Hex *HexMap::nearest(Hex *from, Hex *const *begin, Hex *const *end) {
     Hex *nearest = NULL;
     float min_dist = 999;
-    for(auto&& h : to) {
+    for(Hex *const *it = begin; it != end; ++it) {
+        Hex *h = *it;
         float dist = hex_distance(from, h);
         if(dist < min_dist) {
             min_dist = dist;
@@ -1902,6 +3192,8 @@ vector<Hex *> HexMap::BFS(Hex *base, int range) {
 }
 
 vector<Hex *> HexMap::BFS(Hex *base, int range, Side s, bool base_neighbors, bool ignore_sides) {
+    ai_prof_count(AI_PROF_BFS_CALLS);
+    frame_prof_count(FRAME_BFS_CALLS);
     struct bfsdata {
         float distance;
         bfsdata() { distance = -1; }
@@ -1909,14 +3201,18 @@ vector<Hex *> HexMap::BFS(Hex *base, int range, Side s, bool base_neighbors, boo
 
     vector<bfsdata> hexdata(m_hexes.size());
 
-    deque<Hex *> q;
+    // every hex is queued at most once
+    vector<Hex *> q;
+    q.reserve(m_hexes.size());
     q.push_back(base);
+    ai_prof_count(AI_PROF_ALLOCATIONS, 2);
 
     hexdata[base->m_index].distance = 0;
 
-    while(not q.empty()) {
-        Hex *cur = q.front();
-        q.pop_front();
+    long expanded = 0;
+    for(size_t head = 0; head < q.size(); head++) {
+        Hex *cur = q[head];
+        expanded++;
         for(auto&& neighbor : neighbors(cur)) {
 
             bool not_visited = hexdata[neighbor->m_index].distance == -1;
@@ -1934,14 +3230,18 @@ vector<Hex *> HexMap::BFS(Hex *base, int range, Side s, bool base_neighbors, boo
             }
         }
     }
+    ai_prof_count(AI_PROF_BFS_NODES, expanded);
 
+    auto in_range = [&](Hex *h) {
+        return hexdata[h->m_index].distance != -1
+            && hexdata[h->m_index].distance <= range;
+    };
     vector<Hex *> ret;
+    ret.reserve(count_if(m_hexes.begin(), m_hexes.end(), in_range));
+    if(ret.capacity() > 0) ai_prof_count(AI_PROF_ALLOCATIONS);
     for(auto&& h : m_hexes) {
-        if(hexdata[h->m_index].distance != -1
-           && hexdata[h->m_index].distance <= range)
-            {
-                ret.push_back(h);
-            }
+        if(in_range(h))
+            ret.push_back(h);
     }
     return ret;
 }
@@ -1960,6 +3260,7 @@ void HexMap::undo(void) {
 
     for(size_t i = 0; i < m_hexes.size(); i++) {
         *m_hexes[i] = old_hexes[i];
+        dying(m_hexes[i]);
     }
 
     *(game->controller()) = old_cont;
@@ -2023,27 +3324,158 @@ void HexMap::gen_neighbors() {
 }
 
 
+void HexMap::bounds(float& x1, float& y1, float& x2, float& y2) {
+    x1 = y1 = 0;
+    x2 = y2 = 0;
+    bool first = true;
+    for(auto&& h : m_hexes) {
+        // m_r doesn't shrink with the hex when it dies
+        const float a = 2 * h->m_r;
+        if(first == true or h->m_cx - a < x1) x1 = h->m_cx - a;
+        if(first == true or h->m_cy - a < y1) y1 = h->m_cy - a;
+        if(first == true or h->m_cx + a > x2) x2 = h->m_cx + a;
+        if(first == true or h->m_cy + a > y2) y2 = h->m_cy + a;
+        first = false;
+    }
+}
+
+// hexes don't move once they're made, so the grid only has to be built
+// again when they're added or removed
+void HexMap::update_grid(void) {
+    if(m_grid.size() == (int)m_hexes.size() and m_regions.empty() == false)
+        return;
+
+    const int n = m_hexes.size();
+    vector<float> xs(n), ys(n), rs(n);
+    for(int i = 0; i < n; i++) {
+        xs[i] = m_hexes[i]->m_cx;
+        ys[i] = m_hexes[i]->m_cy;
+        // the same margin as bounds()
+        rs[i] = 2 * m_hexes[i]->m_r;
+    }
+    m_grid.build(n, xs.data(), ys.data(), rs.data());
+
+    m_regions.assign(max(m_grid.cells(), 1), Region());
+    m_hex_region.resize(n);
+    for(int i = 0; i < n; i++) {
+        Hex *h = m_hexes[i];
+        m_hex_region[i] = m_grid.home(i);
+        Region& r = m_regions[m_grid.home(i)];
+        // m_a shrinks when the hex dies, m_r doesn't
+        const float a = h->m_r * 2 / sqrt(3);
+        if(r.m_hexes.empty() == true) {
+            r.m_x1 = h->m_cx - a;
+            r.m_y1 = h->m_cy - a;
+            r.m_x2 = h->m_cx + a;
+            r.m_y2 = h->m_cy + a;
+        } else {
+            r.m_x1 = min(r.m_x1, h->m_cx - a);
+            r.m_y1 = min(r.m_y1, h->m_cy - a);
+            r.m_x2 = max(r.m_x2, h->m_cx + a);
+            r.m_y2 = max(r.m_y2, h->m_cy + a);
+        }
+        r.m_hexes.push_back(h);
+        r.m_stale = true;
+    }
+}
+
+// the AI's copies of the map have no regions, so this does nothing on
+// them
+void HexMap::restyle(Hex *h) {
+    if(h->m_index >= 0 and h->m_index < (int)m_hex_region.size())
+        m_regions[m_hex_region[h->m_index]].m_stale = true;
+}
+
+void HexMap::regions_in(float x1, float y1, float x2, float y2, vector<Region *>& out) {
+    update_grid();
+    m_grid_hits.clear();
+    m_grid.cells_in(x1, y1, x2, y2, m_grid_hits);
+    for(int c : m_grid_hits) {
+        if(m_regions[c].m_hexes.empty() == false)
+            out.push_back(&m_regions[c]);
+    }
+}
+
+void HexMap::hexes_in(float x1, float y1, float x2, float y2, vector<Hex *>& out) {
+    update_grid();
+    m_grid_hits.clear();
+    m_grid.query(x1, y1, x2, y2, m_grid_hits);
+    for(int i : m_grid_hits) out.push_back(m_hexes[i]);
+}
+
+// the same way as avarice-book, so the book's positions match
+void HexMap::gen_topology(void) {
+    vector<MapFileHex> hexes(m_hexes.size());
+    for(auto&& h : m_hexes) {
+        MapFileHex& fh = hexes[h->m_index];
+        fh.m_cx = h->m_cx;
+        fh.m_cy = h->m_cy;
+        fh.m_r = h->m_r;
+    }
+    BoardTopology *topo = new BoardTopology;
+    build_topology(hexes, cannon_min_range, cannon_max_range, *topo);
+    m_topology.reset(topo);
+}
+
+// copies the hexes into b. Resources and the side to move are up to the
+// caller
+void HexMap::to_board(Board& b) {
+    assert((int)m_hexes.size() == b.size());
+    for(auto&& h : m_hexes) {
+        Cell& c = b.m_cells[h->m_index];
+        c.level = max(h->m_level, 0);
+        c.units_free = h->m_units_free;
+        c.units_moved = h->m_units_moved;
+        c.side = (uint8_t)h->m_side;
+        c.flags =
+            (h->m_contains_harvester ? CELL_HARVESTER : 0) |
+            (h->m_contains_armory ? CELL_ARMORY : 0) |
+            (h->m_contains_cannon ? CELL_CANNON : 0) |
+            (h->m_ammo ? CELL_AMMO : 0) |
+            (h->m_loaded_ammo ? CELL_LOADED_AMMO : 0) |
+            (h->m_harvested ? CELL_HARVESTED : 0);
+    }
+}
+
+// legal moves for s on the map as it is now, see Board::gen_moves()
+int HexMap::legal_moves(SideController *s, Move *buf, int cap,
+                        unsigned actions, int src) {
+    assert(m_topology);
+    assert((int)s->m_side < 2);
+
+    if(m_board == NULL)
+        m_board.reset(new Board(m_topology.get()));
+
+    to_board(*m_board);
+    m_board->m_turn = s->m_side;
+    m_board->m_resources[(int)s->m_side] = s->get_resources();
+    m_board->m_carriers[(int)s->m_side] = s->m_carriers;
+    return m_board->gen_moves(buf, cap, actions, src);
+}
+
 bool is_neighbor(Hex *h1, Hex *h2) {
     vector<Hex *> neighbors = map->neighbors(h1);
     return find(neighbors.begin(), neighbors.end(), h2) != neighbors.end();
 }
 
-void HexMap::harvest(void) {
+void HexMap::harvest(SideController *s) {
     for(auto&& h : m_hexes) {
         h->m_harvested = false;
     }
     for(auto&& h : m_hexes) {
-        if(h->alive() && h->m_contains_harvester == true && h->m_side == get_current_side()) {
+        if(h->alive() && h->m_contains_harvester == true && h->m_side == s->m_side) {
             for(auto&& h_neighbor : neighbors(h)) {
                 if(h_neighbor->alive() == true &&
                    h_neighbor->harvested() == false)
                     {
                         h_neighbor->harvest();
-                        game->controller()->add_resources(2);
+                        dying(h_neighbor);
+                        s->add_resources(2);
                     }
             }
             h->harvest();
-            game->controller()->add_resources(2);
+            dying(h);
+            s->add_resources(2);
         }
     }
 }
@@ -2070,6 +3502,7 @@ void HexMap::move_or_attack(Hex *attacker, Hex *defender) {
 
         defender->m_units_moved += moved;
         defender->m_side = attacker->m_side;
+        restyle(defender);
         attacker->m_units_free -= moved;
     }
     else {
@@ -2087,6 +3520,7 @@ void HexMap::move_or_attack(Hex *attacker, Hex *defender) {
             // we've conquered this hex
             defender->m_units_moved = moved - (defender->m_units_free + defender->m_units_moved);
             defender->m_side = attacker->m_side;
+            restyle(defender);
             defender->m_units_free = 0;
             attacker->m_units_free -= moved;
         } else {
@@ -2104,9 +3538,9 @@ void HexMap::move_or_attack(Hex *attacker, Hex *defender) {
 
 }
 
-void HexMap::free_units(void) {
+void HexMap::free_units(Side s) {
     for(auto&& h : m_hexes) {
-        if(h->m_side == get_current_side()) {
+        if(h->m_side == s) {
             h->m_units_free += h->m_units_moved;
             h->m_units_moved = 0;
 
@@ -2119,6 +3553,49 @@ void HexMap::free_units(void) {
     }
 }
 
+// adds what the side to move just did to the replay
+static void record_move(MapAction act, Hex *src, Hex *dst, int amount) {
+    game->m_replay.move({ act,
+                src == NULL ? -1 : src->m_index,
+                dst == NULL ? -1 : dst->m_index,
+                amount });
+}
+
+// the game as it is now, every few turns
+static void record_keyframe(void) {
+    if(game->m_replay.want_keyframe(game->m_turn) == false)
+        return;
+    assert(map->m_topology);
+    Board b(map->m_topology.get());
+    map->to_board(b);
+    b.m_turn = game->side();
+    for(auto&& p : game->m_players) {
+        b.m_resources[(int)p->m_side] = p->get_resources();
+        b.m_carriers[(int)p->m_side] = p->m_carriers;
+    }
+    game->m_replay.keyframe(game->m_turn, b);
+}
+
+// replay_dir/<map>-<seed>.replay
+static void start_recording(const char *map_name) {
+    if(cfg.replay_dir[0] == '\0')
+        return;
+    if(mkdir(cfg.replay_dir, 0755) != 0 and errno != EEXIST) {
+        info("start_recording(): couldn't create %s: %s", cfg.replay_dir, strerror(errno));
+        return;
+    }
+    string name = map_name;
+    name = name.substr(0, name.rfind(".map"));
+    char filename[512];
+    snprintf(filename, sizeof(filename), "%s/%s-%llu.replay",
+             cfg.replay_dir, name.c_str(), (unsigned long long)game->m_seed);
+
+    if(game->m_replay.open(filename, map_name, game->m_seed, map->m_hexes.size()) == true) {
+        info("start_recording(): recording to %s", filename);
+        record_keyframe();
+    }
+}
+
 void MapUI::MapHexSelected(Hex *h) {
     debug("MapUI::MapHexSelected()");
     Hex *prev = NULL;
@@ -2138,6 +3615,7 @@ void MapUI::MapHexSelected(Hex *h) {
        h->m_side == game->m_current_controller->m_side and
        prev == NULL) {
         h->m_active = true;
+        map->restyle(h);
 
         if(get_current_action() == MapAction::MovingUnits) {
             msg->add("Moving %d units.", map->m_moving_units);
@@ -2146,21 +3624,26 @@ void MapUI::MapHexSelected(Hex *h) {
 
     if(get_current_action() == MapAction::MovingUnits) {
         if(prev == NULL) {
-            mark(map->BFS(h, 4));
+            mark_legal(MapAction::MovingUnits, h);
         }
 
         else if (prev != NULL) {
             if(h != prev && prev->m_units_free > 0 && h->alive()) {
-                vector<Hex *> bfs = map->BFS(prev, 4);
-                bool free_move = find(bfs.begin(), bfs.end(), h) != bfs.end();
+                bool free_move = false;
+                int n = legal_moves(MapAction::MovingUnits, prev);
+                for(int i = 0; i < n and free_move == false; i++) {
+                    free_move = m_legal[i].m_dst == h->m_index;
+                }
 
                 if(free_move == true) {
                     map->store_current_state();
+                    record_move(MapAction::MovingUnits, prev, h, map->m_moving_units);
                     map->move_or_attack(prev, h);
                     clear_active_hex();
                 }
                 else if(game->controller()->m_carriers >= 1) {
                     map->store_current_state();
+                    record_move(MapAction::MovingUnits, prev, h, map->m_moving_units);
                     map->move_or_attack(prev, h);
                     clear_active_hex();
                     game->controller()->m_carriers -= 1;
@@ -2186,22 +3669,32 @@ void MapUI::MapHexSelected(Hex *h) {
             return;
         }
 
-        if(map->cannon_in_range(prev, h) == false) {
+        if(prev->m_ammo == false) {
             set_current_action(MapAction::MovingUnits);
             clear_active_hex();
-            msg->add("Target isn't in range.");
+            msg->add("That cannon doesn't have any loaded ammo.");
             return;
         }
 
-        if(prev->m_ammo == false) {
+        // the same rules as the AI, so a cannon can't hit its own side
+        bool legal = false;
+        int n = legal_moves(MapAction::FireCannon, prev);
+        for(int i = 0; i < n and legal == false; i++) {
+            legal = m_legal[i].m_dst == h->m_index;
+        }
+        if(legal == false) {
             set_current_action(MapAction::MovingUnits);
             clear_active_hex();
-            msg->add("That cannon doesn't have any loaded ammo.");
+            if(map->cannon_in_range(prev, h) == false)
+                msg->add("Target isn't in range.");
+            else
+                msg->add("Can't fire at that tile.");
             return;
         }
 
         msg->add("Firing!");
         map->store_current_state();
+        record_move(MapAction::FireCannon, prev, h);
         map->fire_cannon(prev, h);
         //clear_active_hex();
         set_current_action(MapAction::MovingUnits);
@@ -2210,6 +3703,7 @@ void MapUI::MapHexSelected(Hex *h) {
 
         if(h->m_contains_harvester == false) {
             map->store_current_state();
+            record_move(MapAction::BuildHarvester, h);
             game->controller_pay(10);
             map->build_harvester(h);
         }
@@ -2220,6 +3714,7 @@ void MapUI::MapHexSelected(Hex *h) {
     else if(get_current_action() == MapAction::DestroyHarvester) {
         if(h->m_contains_harvester == true) {
             map->store_current_state();
+            record_move(MapAction::DestroyHarvester, h);
             map->destroy_harvester(h);
         }
         clear_active_hex();
@@ -2232,6 +3727,7 @@ void MapUI::MapHexSelected(Hex *h) {
            h->m_loaded_ammo == false)
             {
                 map->store_current_state();
+                record_move(MapAction::AddAmmoToCannon, h);
                 game->controller_pay(20);
                 map->add_cannon_ammo(h);
             }
@@ -2241,6 +3737,7 @@ void MapUI::MapHexSelected(Hex *h) {
     else if(get_current_action() == MapAction::BuildArmory) {
         if(h->m_contains_armory == false) {
             map->store_current_state();
+            record_move(MapAction::BuildArmory, h);
             game->controller_pay(35);
             map->build_armory(h);
         }
@@ -2250,6 +3747,7 @@ void MapUI::MapHexSelected(Hex *h) {
     else if(get_current_action() == MapAction::BuildCannon) {
         if(h->m_contains_cannon == false) {
             map->store_current_state();
+            record_move(MapAction::BuildCannon, h);
             game->controller_pay(30);
             map->build_cannon(h);
         }
@@ -2260,6 +3758,7 @@ void MapUI::MapHexSelected(Hex *h) {
         if(h->m_contains_armory == true) {
             if(game->controller()->get_resources() >= map->m_buying_units * 8) {
                 map->store_current_state();
+                record_move(MapAction::BuildWalker, h, NULL, map->m_buying_units);
                 h->m_units_moved += map->m_buying_units;
                 game->controller_pay(map->m_buying_units * 8);
             } else {
@@ -2295,10 +3794,124 @@ static void draw_game_over(bool m_game_lost) {
     al_draw_text(g_font, colors.white, display_x/2 - x_off, display_y/2+4, 0, txt);
 }
 
+// where the last AI turn spent its time, in the top right corner
+static void draw_ai_profile(const AITurnProfile& p) {
+    const int lines = 2 + AI_PROF_NUM_PHASES + AI_PROF_NUM_COUNTERS;
+    const float line_h = cfg.font_height + 2;
+    const float w = 300;
+    const float x = display_x - w - 10;
+    const float y = 10;
+
+    al_draw_filled_rectangle(x, y, x + w, y + lines * line_h + 10,
+                             al_map_rgba(0, 0, 0, 200));
+
+    float ty = y + 5;
+    al_draw_textf(g_font, colors.white, x + 5, ty, 0, "AI turn %d: %.3fs, %d actions",
+                  p.m_turn, p.m_time, p.m_actions);
+    ty += line_h;
+    for(int i = 0; i < AI_PROF_NUM_PHASES; i++) {
+        al_draw_textf(g_font, colors.white, x + 5, ty, 0, "%s: %.1fms (%ld)",
+                      ai_prof_phase_name(i), p.m_phase_time[i] * 1000.0, p.m_phase_calls[i]);
+        ty += line_h;
+    }
+    ty += line_h;
+    for(int i = 0; i < AI_PROF_NUM_COUNTERS; i++) {
+        al_draw_textf(g_font, colors.white, x + 5, ty, 0, "%s: %ld",
+                      ai_prof_counter_name(i), p.m_counters[i]);
+        ty += line_h;
+    }
+}
+
+// works out the region's color again if one of its hexes was
+// restyled since the last time
+static void update_region_color(HexMap::Region& reg, bool dim) {
+    if(reg.m_stale == false and reg.m_dim == dim)
+        return;
+
+    float r = 0, g = 0, b = 0;
+    int n = 0;
+    for(auto&& h : reg.m_hexes) {
+        if(h->alive() == false) continue;
+        float hr, hg, hb;
+        ALLEGRO_COLOR txt_color;
+        h->look(hr, hg, hb, txt_color);
+        r += hr;
+        g += hg;
+        b += hb;
+        n++;
+    }
+    reg.m_dim = dim;
+    reg.m_stale = false;
+    reg.m_alive = n;
+    if(n > 0)
+        reg.m_color = al_map_rgb_f(r / n, g / n, b / n);
+}
+
+// far out each region of the map is one tile in the average color of
+// its hexes
+static void draw_regions(void) {
+    visible_regions.clear();
+    map->regions_in(view_x, view_y,
+                    view_x + display_x / scale, view_y + display_y / scale,
+                    visible_regions);
+
+    const bool dim = marked_hexes();
+    for(auto&& reg : visible_regions) {
+        update_region_color(*reg, dim);
+        if(reg->m_alive == 0) continue;
+
+        frame_prof_count(FRAME_HEXES_DRAWN, reg->m_alive);
+        hex_batch.add_rect(vx(reg->m_x1), vy(reg->m_y1), vx(reg->m_x2), vy(reg->m_y2),
+                           reg->m_color);
+    }
+    hex_batch.draw();
+}
+
 void MapUI::draw(void) {
-    // draw normal hexes
-    for(auto&& h : map->m_hexes) {
-        h->draw();
+    // draw the hexes on the screen, only redrawing the ones that
+    // changed, then their text on top. Hexes off the screen are left
+    // as they were in the layer until they're scrolled to. Zoomed out
+    // the text is left out, and further out the hexes are drawn by
+    // region
+    const float zoom = scale * 100;
+    {
+        FrameProfTimer t(FRAME_HEXES);
+        if(zoom < cfg.lod_region_zoom) {
+            draw_regions();
+        } else {
+            float x1, y1, x2, y2;
+            map->bounds(x1, y1, x2, y2);
+            find_visible_hexes();
+            frame_prof_count(FRAME_HEXES_DRAWN, visible_hexes.size());
+            if(hex_gl.ready() == true) {
+                // every hex is drawn, so all of them have to be up to
+                // date, even the ones that aren't visible. Only the
+                // ones that changed are uploaded
+                hex_gl.begin(map->m_hexes.size());
+                for(auto&& h : map->m_hexes) {
+                    h->draw(hex_gl);
+                }
+                hex_gl.draw(view_x, view_y, scale, marked_hexes());
+            }
+            else if(m_layer.begin(map->m_hexes.size(), x1, y1, x2, y2, scale) == true) {
+                for(auto&& h : visible_hexes) {
+                    h->draw(m_layer);
+                }
+                m_layer.draw(view_x, view_y);
+            } else {
+                for(auto&& h : visible_hexes) {
+                    h->draw(hex_batch);
+                }
+                hex_batch.draw();
+            }
+
+            if(zoom >= cfg.lod_label_zoom) {
+                for(auto&& h : visible_hexes) {
+                    h->draw_label(hex_labels);
+                }
+                hex_labels.draw();
+            }
+        }
     }
 
     if(m_game_won or m_game_lost) {
@@ -2314,6 +3927,49 @@ void MapUI::draw(void) {
             }
         }
     }
+
+    if(m_ai_replay == true) {
+        const double t = (al_get_time() - m_ai_batch_start) / max(m_ai_batch_time, 0.001);
+        ai_draw_batch(min(t, 1.0));
+    }
+
+    if(m_draw_ai_profile == true and ai_have_profile == true)
+        draw_ai_profile(ai_last_profile);
+}
+
+// frame times and where they went, in the top left corner
+static void draw_frame_profile_overlay(void) {
+    const FrameProfile& p = frame_profile;
+    const FrameSample avg = p.average();
+    const FrameSample& last = p.last();
+    const int lines = 3 + FRAME_NUM_STAGES + FRAME_NUM_COUNTERS;
+    const float line_h = cfg.font_height + 2;
+    const float w = 300;
+    const float x = 10;
+    const float y = 10;
+
+    al_draw_filled_rectangle(x, y, x + w, y + lines * line_h + 10,
+                             al_map_rgba(0, 0, 0, 200));
+
+    float ty = y + 5;
+    al_draw_textf(g_font, colors.white, x + 5, ty, 0, "%d frames, avg %.2fms",
+                  p.frames(), avg.m_time * 1000.0);
+    ty += line_h;
+    al_draw_textf(g_font, colors.white, x + 5, ty, 0, "p50 %.2f p90 %.2f p99 %.2f max %.2f",
+                  p.percentile(50) * 1000.0, p.percentile(90) * 1000.0,
+                  p.percentile(99) * 1000.0, p.percentile(100) * 1000.0);
+    ty += line_h;
+    for(int i = 0; i < FRAME_NUM_STAGES; i++) {
+        al_draw_textf(g_font, colors.white, x + 5, ty, 0, "%s: %.2fms",
+                      frame_prof_stage_name(i), avg.m_stage_time[i] * 1000.0);
+        ty += line_h;
+    }
+    ty += line_h;
+    for(int i = 0; i < FRAME_NUM_COUNTERS; i++) {
+        al_draw_textf(g_font, colors.white, x + 5, ty, 0, "%s: %ld",
+                      frame_prof_counter_name(i), last.m_counters[i]);
+        ty += line_h;
+    }
 }
 
 static void end_turn_cb(void);
@@ -2323,7 +3979,8 @@ void MapUI::update(void) {
 
     if(m_ai_replay == true) {
         if(al_key_down(&keyboard_state, ALLEGRO_KEY_S)) {
-            while(ai_replay()) {};
+            while(ai_replay())
+                ;
             m_ai_acts.clear();
             m_ai_replay = false;
             end_turn_cb();
@@ -2331,18 +3988,22 @@ void MapUI::update(void) {
             return;
         }
 
-        if(m_ai_play_time >= m_ai_play_delay) {
-            if(ai_replay() == false) {
-                m_ai_acts.clear();
-                m_ai_replay = false;
-                end_turn_cb();
-                set_redraw();
-                return;
-            }
-            set_redraw();
-            m_ai_play_time = 0;
+        // a batch's actions are done once its animation is over. Every
+        // batch that's over is done, even if the frames are slower than
+        // the batches, and the turn ends right after the last one
+        while(m_ai_batch < (int)m_ai_batches.size() and
+              al_get_time() - m_ai_batch_start >= m_ai_batch_time) {
+            while(m_ai_acts_stage < m_ai_batches[m_ai_batch] and ai_replay())
+                ;
+            m_ai_batch++;
+            m_ai_batch_start += m_ai_batch_time;
+        }
+        if(m_ai_batch >= (int)m_ai_batches.size()) {
+            m_ai_acts.clear();
+            m_ai_replay = false;
+            end_turn_cb();
         }
-        m_ai_play_time++;
+        set_redraw();
         return;
     }
 
@@ -2366,7 +4027,8 @@ void MapUI::update(void) {
         set_redraw();
     }
 
-    float ds = 1.02;
+    // 1.02 a tick at the old fixed 30Hz, whatever the frame rate
+    float ds = pow(1.02, dt * 30);
     if(al_key_down(&keyboard_state, ALLEGRO_KEY_OPENBRACE)) {
         scale *= ds;
         set_redraw();
@@ -2447,6 +4109,13 @@ static void allegro_init() {
     else
         info("Created display.");
 
+    // everything draw_text() writes
+    if(hex_labels.init(g_font, "0123456789-/HAC") == false)
+        info("Drawing hex labels with al_draw_text()");
+
+    if(cfg.hex_instancing == true)
+        hex_gl.init();
+
     ret = al_install_keyboard();
     if(ret == false)
         fatal_error("Failed to initialize keyboard.");
@@ -2465,7 +4134,7 @@ static void allegro_init() {
     else
         info("Created event queue.");
 
-    timer = al_create_timer(1.0 / 30.0);
+    timer = al_create_timer(1.0 / max((int)cfg.frame_rate, 1));
     if(timer == NULL)
         fatal_error("Error: failed to create timer.");
     else
@@ -2476,6 +4145,7 @@ static void allegro_init() {
     al_register_event_source(event_queue, al_get_display_event_source(display));
     al_register_event_source(event_queue, al_get_timer_event_source(timer));
     al_register_event_source(event_queue, al_get_keyboard_event_source());
+    al_register_event_source(event_queue, al_get_mouse_event_source());
 }
 
 Hex *addHex(float x, float y, float a, int level, int index) {
@@ -2517,12 +4187,12 @@ static void end_turn_cb(void) {
 
     is_won();
 
+    game->m_replay.end_turn(game->m_turn, game->side());
     SideController *s = game->get_next_controller();
 
-    map->harvest();
-    s->add_resources(4);
-    map->free_units();
+    begin_turn(map, s);
     map->clear_old_states();
+    record_keyframe();
 
     clear_active_hex();
     clear_opt_buttons();
@@ -2531,7 +4201,14 @@ static void end_turn_cb(void) {
     msg->add("It's %s's turn", s->m_name);
 
     if(s->is_AI() == true) {
-        Map_UI->ai_play(s->do_AI());
+        vector<AIAction> acts;
+        SideController *enemy = game->opponent(s);
+        if(ai_spec == NULL or ai_spec->take(map, s, enemy, acts) == false) {
+            acts = s->do_AI(enemy);
+        }
+        Map_UI->ai_play(acts);
+    } else {
+        ai_speculate();
     }
     center_view_on_alive_hexes(map->m_hexes);
 }
@@ -2540,12 +4217,7 @@ static void build_harvester_cb(void) {
     if(game->controller_has_resources(10)) {
         clear_active_hex();
 
-        vector<Hex *> mark;
-        for(auto&& h : map->m_hexes)
-            if(h->alive() && h->m_side == game->controller()->m_side &&
-               h->m_contains_harvester == false)
-                mark.push_back(h);
-        Map_UI->mark(mark);
+        Map_UI->mark_legal(MapAction::BuildHarvester);
 
         msg->add("Select hex to build on.");
         Map_UI->set_current_action(MapAction::BuildHarvester);
@@ -2558,20 +4230,13 @@ static void build_harvester_cb(void) {
 static void destroy_harvester_cb(void) {
     clear_active_hex();
 
-    vector<Hex *> mark;
-    for(auto&& h : map->m_hexes)
-        if(h->alive() && h->m_side == game->controller()->m_side &&
-           h->m_contains_harvester == true)
-            mark.push_back(h);
-
-    if(mark.empty() == true) {
+    if(Map_UI->mark_legal(MapAction::DestroyHarvester) == 0) {
         msg->add("You don't have any harvesters.");
         clear_opt_buttons();
         return;
     }
 
     msg->add("Select harvester to destroy.");
-    Map_UI->mark(mark);
 
     Map_UI->set_current_action(MapAction::DestroyHarvester);
 }
@@ -2579,12 +4244,7 @@ static void build_armory_cb(void) {
     if(game->controller_has_resources(35)) {
         clear_active_hex();
 
-        vector<Hex *> mark;
-        for(auto&& h : map->m_hexes)
-            if(h->alive() && h->m_side == game->controller()->m_side &&
-               h->m_contains_armory == false)
-                mark.push_back(h);
-        Map_UI->mark(mark);
+        Map_UI->mark_legal(MapAction::BuildArmory);
 
         msg->add("Select hex to build on.");
         Map_UI->set_current_action(MapAction::BuildArmory);
@@ -2596,6 +4256,7 @@ static void build_armory_cb(void) {
 static void build_carrier_cb(void) {
     if(game->controller_has_resources(50)) {
         map->store_current_state();
+        record_move(MapAction::BuildCarrier, NULL);
         game->controller_pay(50);
         game->controller()->m_carriers += 1;
         clear_active_hex();
@@ -2607,22 +4268,14 @@ static void build_carrier_cb(void) {
     }
 }
 static void build_walker_cb(void) {
-    vector<Hex *> mark;
-    for(auto&& h : map->m_hexes)
-        if(h->alive() && h->m_side == game->controller()->m_side &&
-           h->m_contains_armory == true)
-            mark.push_back(h);
-
-    if(mark.empty() == true) {
-        msg->add("You don't have any armories.");
-        clear_opt_buttons();
-        return;
-    }
-
     if(game->controller_has_resources(8)) {
         clear_active_hex();
 
-        Map_UI->mark(mark);
+        if(Map_UI->mark_legal(MapAction::BuildWalker) == 0) {
+            msg->add("You don't have any armories.");
+            clear_opt_buttons();
+            return;
+        }
 
         msg->add("Select hex to recruit on. (max: %d)",
                  int(floor(float(game->controller()->get_resources()) / 8.0)));
@@ -2636,15 +4289,7 @@ static void build_cannon_cb(void) {
     if(game->controller_has_resources(30)) {
         clear_active_hex();
 
-        vector<Hex *> mark;
-        for(auto&& h : map->m_hexes) {
-            if(h->alive() && h->m_side == game->controller()->m_side &&
-               h->m_contains_cannon == false) {
-                mark.push_back(h);
-            }
-        }
-
-        Map_UI->mark(mark);
+        Map_UI->mark_legal(MapAction::BuildCannon);
 
         msg->add("Select hex to build on.");
         Map_UI->set_current_action(MapAction::BuildCannon);
@@ -2654,24 +4299,14 @@ static void build_cannon_cb(void) {
     }
 }
 static void build_cannon_ammo_cb(void) {
-    vector<Hex *> mark;
-    for(auto&& h : map->m_hexes) {
-        if(h->alive() && h->m_side == game->controller()->m_side &&
-           h->m_contains_cannon == true && h->m_ammo == false && h->m_loaded_ammo == false) {
-            mark.push_back(h);
-        }
-    }
-
-    if(mark.size() == 0) {
-        msg->add("You don't have any cannons to load.");
-        clear_opt_buttons();
-        return;
-    }
-
     if(game->controller_has_resources(20)) {
         clear_active_hex();
 
-        Map_UI->mark(mark);
+        if(Map_UI->mark_legal(MapAction::AddAmmoToCannon) == 0) {
+            msg->add("You don't have any cannons to load.");
+            clear_opt_buttons();
+            return;
+        }
 
         msg->add("Select cannon to add ammo to.");
         Map_UI->set_current_action(MapAction::AddAmmoToCannon);
@@ -2705,19 +4340,19 @@ static void fire_cannon_cb(void) {
     }
 
     Map_UI->clear_mark();
-    vector<Hex *> hexes_in_range;
-    for(auto&& h : map->m_hexes) {
-        float dist = map->hex_distance(act, h);
-        if(dist > (0.4 + 2 * map->m_cannon_min_range) * act->m_circle_bb_radius and dist < (0.4 + 5 * map->m_cannon_max_range) * act->m_circle_bb_radius) {
-            hexes_in_range.push_back(h);
-        }
+    if(Map_UI->mark_legal(MapAction::FireCannon, act) == 0) {
+        msg->add("There aren't any targets in range.");
+        Map_UI->set_current_action(MapAction::MovingUnits);
+        clear_opt_buttons();
+        return;
     }
-    Map_UI->mark(hexes_in_range);
 
     msg->add("Select a target.");
     Map_UI->set_current_action(MapAction::FireCannon);
 }
 static void map_undo_cb(void) {
+    if(map->m_old_states.empty() == false)
+        game->m_replay.undo();
     map->undo();
     btn_outlines_update();
 }
@@ -3059,6 +4694,10 @@ static void init_buttons() {
 static void init(void) {
     allegro_init();
 
+    ai_pool = new WorkerPool(cfg.ai_threads);
+    // 2^18 slots, 6 MB
+    ai_tt = new TranspositionTable(18);
+
     init_colors();
     MainMenu_UI = new MainMenuUI;
     GameSetup_UI = new GameSetupUI;
@@ -3067,8 +4706,16 @@ static void init(void) {
 }
 
 static void new_game(GameType t) {
+    uint64_t seed = cfg.game_seed;
+    if(seed == 0)
+        seed = chrono::system_clock::now().time_since_epoch().count();
+    info("new_game(): seed %llu", (unsigned long long)seed);
+
+    // nothing is searching between games
+    ai_tt->clear();
+
     map = new HexMap;
-    game = new Game(t, map, 2);
+    game = new Game(t, map, 2, seed);
     msg = new MessageLog;
     Map_UI = new MapUI;
     MapEditor_UI = new MapEditorUI;
@@ -3081,9 +4728,17 @@ static void new_game(GameType t) {
         Map_UI->addWidget(msg);
 
         game->m_players[0]->m_ai_control = false;
-        if(strcmp(GameSetup_UI->m_selected_player->m_name, "vs. Human") == 0) {
+        const char *player = GameSetup_UI->m_selected_player->m_name;
+        if(strcmp(player, "Blue.human") == 0) {
             game->m_players[1]->m_ai_control = false;
         }
+        else if(strcmp(player, "Blue.MCTS") == 0) {
+            game->m_players[1]->m_engine = AIEngine::MCTS;
+        }
+        for(int d = 0; d < AI_NUM_DIFFICULTIES; d++) {
+            if(GameSetup_UI->m_difficulty_select_btns[d] == GameSetup_UI->m_selected_difficulty)
+                game->m_players[1]->m_difficulty = (AIDifficulty)d;
+        }
 
         const char *map_name = GameSetup_UI->m_selected_map->m_name;
         debug("new_game(): Map name %s selected", map_name);
@@ -3102,6 +4757,13 @@ static void new_game(GameType t) {
         if(in.fail() == true) fatal_error("new_game(): Couldn't load %s", map_name);
         map->load(in, true);
         for(auto&& h : map->m_hexes) Map_UI->addWidget(h);
+
+        // built by avarice-book
+        string book = string("maps/") + map_name;
+        book = book.substr(0, book.rfind(".map")) + ".book";
+        if(game->m_book.load(book.c_str()) == true) {
+            for(auto&& p : game->m_players) p->m_book = &game->m_book;
+        }
         msg->add("It's %s's turn", game->controller()->m_name);
         center_view_on_hexes(map->m_hexes);
         btn_outlines_update();
@@ -3130,12 +4792,26 @@ static void new_game(GameType t) {
     }
 
     map->gen_neighbors();
+
+    if(t == GameType::Game) {
+        map->gen_topology();
+        // the first keyframe needs the topology
+        start_recording(GameSetup_UI->m_selected_map->m_name);
+    }
+
+    if(t == GameType::Game and cfg.ai_speculation == true) {
+        ai_spec = new AISpeculation;
+        ai_speculate();
+    }
 }
 
 static void delete_game(void) {
     assert(MainMenu_UI);
     switch_ui(MainMenu_UI);
 
+    delete ai_spec;
+    ai_spec = NULL;
+
     delete map;
     delete Map_UI;
     delete MapEditor_UI;
@@ -3156,7 +4832,10 @@ void clear_opt_buttons(void) {
 
 static void clear_active_hex(void) {
     for(auto &&h : map->m_hexes) {
-        h->m_active = false;
+        if(h->m_active == true) {
+            h->m_active = false;
+            map->restyle(h);
+        }
     }
     Map_UI->clear_mark();
 }
@@ -3182,6 +4861,15 @@ bool handle_global_keys(void) {
         pressEsc();
         return true;
     }
+    if(key == ALLEGRO_KEY_F) {
+        draw_frame_profile = !draw_frame_profile;
+        // frames are only timed while someone's looking
+        if(draw_frame_profile == true or cfg.frame_profile_file[0] != '\0')
+            frame_prof = &frame_profile;
+        else
+            frame_prof = NULL;
+        return true;
+    }
     if(ui == Map_UI) {
         int m = -1;
         // add button shortcuts
@@ -3208,11 +4896,23 @@ bool handle_global_keys(void) {
     return true;
 }
 
+/*
+  Everything happens on events: input as it comes, and the UI's update()
+  on timer ticks. When a tick's update() doesn't ask for a redraw
+  nothing is animating, so the timer is stopped until the next input
+  and the loop sleeps in al_wait_for_event().
+ */
 void mainloop() {
-    bool was_mouse_down = false;
+    // the mouse buttons held down, like ALLEGRO_MOUSE_STATE::buttons
+    int mouse_buttons = 0;
+    // the timer's count at the last tick, or -1 if it was just started
+    int64_t last_tick = -1;
 
     register_global_key_callback(handle_global_keys);
 
+    if(cfg.frame_profile_file[0] != '\0' and frame_profile.open_csv(cfg.frame_profile_file) == true)
+        frame_prof = &frame_profile;
+
     ALLEGRO_EVENT ev;
 
     running = true;
@@ -3221,49 +4921,69 @@ void mainloop() {
 
     // main loop
     while(running) {
-        double frame_start;
-        double frame_end;
-        bool draw_hover = false;
-        frame_start = al_current_time();
-
-        al_get_mouse_state(&mouse_state);
-        al_get_keyboard_state(&keyboard_state);
-
-        mouse_x = mouse_state.x;
-        mouse_y = mouse_state.y;
-
-        // 1 - RMB
-        // 2 - LMB
-        // 4 - wheel
-        mouse_button = mouse_state.buttons;
-
-        if (mouse_state.buttons != 0) {
-            if (!was_mouse_down) {
-                // mouse button down event
-                ui->mouseDownEvent();
-                was_mouse_down = true;
-            }
+        al_wait_for_event(event_queue, &ev);
+        // the wait doesn't count towards the frame's time
+        double busy_start = al_get_time();
+
+        // input wakes the timer, in case it starts an animation
+        if(ev.type != ALLEGRO_EVENT_TIMER and al_get_timer_started(timer) == false) {
+            al_start_timer(timer);
+            last_tick = -1;
+        }
+
+        if(ev.type == ALLEGRO_EVENT_MOUSE_AXES) {
+            mouse_x = ev.mouse.x;
+            mouse_y = ev.mouse.y;
         }
-        else if (was_mouse_down) {
+        else if(ev.type == ALLEGRO_EVENT_MOUSE_BUTTON_DOWN) {
+            FrameProfTimer t(FRAME_INPUT);
+            mouse_x = ev.mouse.x;
+            mouse_y = ev.mouse.y;
+            // 1 - LMB
+            // 2 - RMB
+            // 4 - wheel
+            mouse_button = 1 << (ev.mouse.button - 1);
+            mouse_buttons |= mouse_button;
+            ui->mouseDownEvent();
+        }
+        else if(ev.type == ALLEGRO_EVENT_MOUSE_BUTTON_UP) {
+            FrameProfTimer t(FRAME_INPUT);
+            mouse_x = ev.mouse.x;
+            mouse_y = ev.mouse.y;
+            mouse_button = 1 << (ev.mouse.button - 1);
+            mouse_buttons &= ~mouse_button;
             ui->mouseUpEvent();
-            // mouse up event
-            was_mouse_down = false;
-        } else {
-            draw_hover = true;
-            // hover event
         }
-
-        al_wait_for_event(event_queue, &ev);
-
-        if(ev.type == ALLEGRO_EVENT_KEY_DOWN) {
+        else if(ev.type == ALLEGRO_EVENT_KEY_DOWN) {
+            FrameProfTimer t(FRAME_INPUT);
             key = ev.keyboard.keycode;
             ui->keyDownEvent();
         }
         else if(ev.type == ALLEGRO_EVENT_TIMER) {
+            // ticks missed while busy are made up for in one update
+            const int64_t ticks = last_tick < 0 ? 1 : ev.timer.count - last_tick;
+            last_tick = ev.timer.count;
+            dt = max((int64_t)1, ticks) * al_get_timer_speed(timer);
+
+            // held keys are only looked at on ticks
+            {
+                FrameProfTimer t(FRAME_INPUT);
+                al_get_keyboard_state(&keyboard_state);
+            }
+
+            const bool had_redraw = redraw;
+            redraw = false;
             { // logic goes here
+                FrameProfTimer t(FRAME_UPDATE);
                 ui->update();
             }
-            // set_redraw();
+            if(redraw == false)
+                al_stop_timer(timer);
+            redraw = redraw or had_redraw;
+        }
+        else if(ev.type == ALLEGRO_EVENT_DISPLAY_EXPOSE or
+                ev.type == ALLEGRO_EVENT_DISPLAY_SWITCH_IN) {
+            set_redraw();
         }
         else if(ev.type == ALLEGRO_EVENT_DISPLAY_CLOSE) {
             running = false;
@@ -3275,15 +4995,32 @@ void mainloop() {
             al_clear_to_color(ui->clear_to);
 
             { // drawing goes here
+                const double draw_start = al_get_time();
                 ui->draw();
-                if(draw_hover == true)
+                if(mouse_buttons == 0)
                     ui->hoverOverEvent();
+                if(draw_frame_profile == true)
+                    draw_frame_profile_overlay();
+                // the UI's draw() times its own hexes, the rest is
+                // widgets
+                if(frame_prof != NULL)
+                    frame_prof->add_time(FRAME_WIDGETS, al_get_time() - draw_start
+                                         - frame_prof->stage_time(FRAME_HEXES));
+            }
+            {
+                FrameProfTimer t(FRAME_FLIP);
+                al_flip_display();
+            }
+
+            if(frame_prof != NULL) {
+                frame_prof->add_busy(al_get_time() - busy_start);
+                frame_prof->end_frame();
             }
-            al_flip_display();
+            busy_start = al_get_time();
         }
 
-        frame_end = al_current_time();
-        dt = frame_end - frame_start;
+        if(frame_prof != NULL)
+            frame_prof->add_busy(al_get_time() - busy_start);
     }
 }
 
@@ -3292,6 +5029,8 @@ static void deinit(void) {
         delete_game();
     delete GameSetup_UI;
     delete MainMenu_UI;
+    delete ai_tt;
+    delete ai_pool;
 }
 
 int main() {
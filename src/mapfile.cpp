@@ -0,0 +1,70 @@
+#include "./mapfile.h"
+
+#include <cmath>
+
+using namespace std;
+
+bool read_map_file(istream& is, vector<MapFileHex>& out) {
+    int size;
+    is >> size;
+    if(is.fail() == true)
+        return false;
+
+    out.clear();
+    for(int i = 0; i < size; i++) {
+        // same fields as Hex::load
+        int index, level, active, marked, harvester, harvested, armory,
+            cannon, ammo, loaded_ammo, units_free, units_moved, side;
+        float a, r, cx, cy;
+        is >> index >> level >> a
+           >> r >> active >> marked
+           >> cx >> cy >> harvester
+           >> harvested >> armory
+           >> cannon >> ammo
+           >> loaded_ammo >> units_free
+           >> units_moved >> side;
+        if(is.fail() == true)
+            return false;
+        if(level < 1)
+            continue;
+
+        MapFileHex h;
+        h.m_cx = cx;
+        h.m_cy = cy;
+        h.m_r = r;
+        h.m_cell.level = level;
+        h.m_cell.units_free = units_free;
+        h.m_cell.units_moved = units_moved;
+        h.m_cell.side = side;
+        h.m_cell.flags =
+            (harvester ? CELL_HARVESTER : 0) |
+            (armory ? CELL_ARMORY : 0) |
+            (cannon ? CELL_CANNON : 0) |
+            (ammo ? CELL_AMMO : 0) |
+            (loaded_ammo ? CELL_LOADED_AMMO : 0) |
+            (harvested ? CELL_HARVESTED : 0);
+        out.push_back(h);
+    }
+    return true;
+}
+
+void build_topology(const vector<MapFileHex>& hexes,
+                    float cannon_min_range, float cannon_max_range,
+                    BoardTopology& topo) {
+    for(auto&& base : hexes) {
+        vector<int> ns;
+        vector<int> targets;
+        for(int j = 0; j < (int)hexes.size(); j++) {
+            const MapFileHex& h = hexes[j];
+            float dist = sqrt(pow(base.m_cx - h.m_cx, 2) + pow(base.m_cy - h.m_cy, 2));
+            // HexMap::gen_neighbors
+            if(dist < 2 * base.m_r + 10 and &h != &base)
+                ns.push_back(j);
+            // HexMap::cannon_in_range
+            if(dist > (0.4 + 2 * cannon_min_range) * base.m_r and
+               dist < (0.4 + 2 * cannon_max_range) * base.m_r)
+                targets.push_back(j);
+        }
+        topo.add_hex(ns, targets);
+    }
+}
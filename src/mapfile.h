@@ -0,0 +1,29 @@
+#pragma once
+
+#include <istream>
+#include <vector>
+
+#include "./board.h"
+
+// how far cannons reach, in hexes
+const float cannon_min_range = 1;
+const float cannon_max_range = 5;
+
+// what Board needs from a hex in a .map file
+struct MapFileHex {
+    float m_cx;
+    float m_cy;
+    // radius of the inscribed circle
+    float m_r;
+    Cell m_cell;
+};
+
+// reads the hexes of a .map file that HexMap::load(is, true) keeps.
+// Returns false if the file ends early
+bool read_map_file(std::istream& is, std::vector<MapFileHex>& out);
+
+// neighbors and cannon targets by distance between the hexes, the same
+// as the game's HexMap
+void build_topology(const std::vector<MapFileHex>& hexes,
+                    float cannon_min_range, float cannon_max_range,
+                    BoardTopology& topo);
@@ -0,0 +1,129 @@
+#include "./maplayer.h"
+
+#include <cmath>
+
+#include "./frameprof.h"
+#include "./util.h"
+
+using namespace std;
+
+// bigger layers are drawn directly instead
+static const int max_layer_size = 8192;
+// the same gaps as Hex::draw
+static const float fill_space = 4;
+static const float marked_space = 2;
+
+MapLayer::MapLayer() {
+    m_bitmap = NULL;
+    m_x1 = m_y1 = m_x2 = m_y2 = 0;
+    m_scale = 0;
+    m_last_scale = 0;
+    m_w = m_h = 0;
+    m_failed = false;
+    m_redrawn = 0;
+}
+
+MapLayer::~MapLayer() {
+    if(m_bitmap != NULL)
+        al_destroy_bitmap(m_bitmap);
+}
+
+void MapLayer::invalidate(void) {
+    fill(m_valid.begin(), m_valid.end(), 0);
+}
+
+bool MapLayer::begin(int n, float x1, float y1, float x2, float y2, float scale) {
+    m_redrawn = 0;
+
+    if(n != (int)m_sig.size()) {
+        m_sig.assign(n, 0);
+        m_valid.assign(n, 0);
+        m_drawn_a.assign(n, 0);
+    }
+
+    // redrawing the whole layer every frame while zooming would be
+    // slower than drawing the hexes directly
+    const bool zooming = scale != m_last_scale;
+    m_last_scale = scale;
+
+    if(m_bitmap != NULL and
+       x1 == m_x1 and y1 == m_y1 and x2 == m_x2 and y2 == m_y2 and scale == m_scale)
+        return true;
+    if(zooming == true)
+        return false;
+
+    m_x1 = x1;
+    m_y1 = y1;
+    m_x2 = x2;
+    m_y2 = y2;
+    m_scale = scale;
+    invalidate();
+    fill(m_drawn_a.begin(), m_drawn_a.end(), 0);
+
+    const int w = ceil((x2 - x1) * scale);
+    const int h = ceil((y2 - y1) * scale);
+    // an old bitmap that's big enough is kept, unless it's much too big
+    const int bw = m_bitmap == NULL ? 0 : al_get_bitmap_width(m_bitmap);
+    const int bh = m_bitmap == NULL ? 0 : al_get_bitmap_height(m_bitmap);
+    if(w > 0 and h > 0 and w <= bw and h <= bh and bw <= 2 * w and bh <= 2 * h) {
+        m_failed = false;
+    } else {
+        if(m_bitmap != NULL)
+            al_destroy_bitmap(m_bitmap);
+        m_bitmap = NULL;
+        if(w > 0 and h > 0 and w <= max_layer_size and h <= max_layer_size)
+            m_bitmap = al_create_bitmap(w, h);
+        if(m_bitmap == NULL) {
+            if(m_failed == false)
+                debug("MapLayer::begin(): no %dx%d layer, drawing directly", w, h);
+            m_failed = true;
+            return false;
+        }
+        m_failed = false;
+    }
+    m_w = w;
+    m_h = h;
+
+    ALLEGRO_STATE state;
+    al_store_state(&state, ALLEGRO_STATE_TARGET_BITMAP);
+    al_set_target_bitmap(m_bitmap);
+    al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+    al_restore_state(&state);
+    return true;
+}
+
+void MapLayer::hex(int i, uint64_t sig, float x, float y, float a, bool marked, ALLEGRO_COLOR fill) {
+    if(m_valid[i] and m_sig[i] == sig)
+        return;
+    m_valid[i] = 1;
+    m_sig[i] = sig;
+    m_redrawn++;
+
+    // the old hex, with what's around it up to where the neighbors start
+    if(m_drawn_a[i] > 0)
+        m_clear.add(lx(x), ly(y), m_drawn_a[i] * m_scale, al_map_rgba(0, 0, 0, 0));
+    m_drawn_a[i] = a;
+    if(a <= 0)
+        return;
+
+    if(marked == true)
+        m_fill.add(lx(x), ly(y), m_scale * (a - marked_space), al_map_rgb_f(1, 1, 1));
+    m_fill.add(lx(x), ly(y), m_scale * (a - fill_space), fill);
+}
+
+void MapLayer::draw(float view_x, float view_y) {
+    if(m_clear.size() > 0 or m_fill.size() > 0) {
+        ALLEGRO_STATE state;
+        al_store_state(&state, ALLEGRO_STATE_TARGET_BITMAP | ALLEGRO_STATE_BLENDER);
+        al_set_target_bitmap(m_bitmap);
+        // the cleared hexes have to become transparent
+        al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO);
+        m_clear.draw();
+        m_fill.draw();
+        al_restore_state(&state);
+    }
+
+    al_draw_bitmap_region(m_bitmap, 0, 0, m_w, m_h, floor((m_x1 - view_x) * m_scale),
+                          floor((m_y1 - view_y) * m_scale), 0);
+    frame_prof_count(FRAME_DRAW_CALLS);
+}
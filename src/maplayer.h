@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <allegro5/allegro.h>
+
+#include "./hexbatch.h"
+
+/*
+  The map's hexes drawn into a bitmap that's kept between frames. Each
+  frame every hex is passed to hex() with a signature of how it looks,
+  and only the ones whose signature changed are redrawn into the
+  bitmap. Panning just draws the bitmap at another offset. While the
+  scale is changing the layer isn't used, and it's redrawn at the new
+  scale once the scale stays the same for a frame.
+ */
+struct MapLayer {
+    MapLayer();
+    ~MapLayer();
+
+    // starts a frame for n hexes inside the world rectangle (x1, y1,
+    // x2, y2) at scale. Returns false if the layer can't be used, e.g.
+    // because the bitmap would be too big or the view is being zoomed
+    bool begin(int n, float x1, float y1, float x2, float y2, float scale);
+    // hex i at world position (x, y) with side a and an outline if
+    // marked, or nothing if a is 0
+    void hex(int i, uint64_t sig, float x, float y, float a, bool marked, ALLEGRO_COLOR fill);
+    // redraws the changed hexes into the bitmap and draws it to the
+    // current target, for the view at (view_x, view_y)
+    void draw(float view_x, float view_y);
+
+    void invalidate(void);
+
+    // hexes redrawn in the last frame
+    int m_redrawn;
+
+private:
+    ALLEGRO_BITMAP *m_bitmap;
+    float m_x1;
+    float m_y1;
+    float m_x2;
+    float m_y2;
+    float m_scale;
+    // the scale passed to the last begin()
+    float m_last_scale;
+    // the part of m_bitmap in use, which can be bigger
+    int m_w;
+    int m_h;
+    bool m_failed;
+
+    std::vector<uint64_t> m_sig;
+    std::vector<uint8_t> m_valid;
+    // size each hex was last drawn at, to clear it
+    std::vector<float> m_drawn_a;
+
+    HexBatch m_clear;
+    HexBatch m_fill;
+
+    float lx(float x) const { return (x - m_x1) * m_scale; }
+    float ly(float y) const { return (y - m_y1) * m_scale; }
+};
@@ -0,0 +1,345 @@
+#include "./mcts.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "./ttable.h"
+#include "./workers.h"
+
+using namespace std;
+
+// size of the move buffer for one position
+static const int max_moves = 8192;
+
+static double now(void) {
+    return chrono::duration<double>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+MCTSParams::MCTSParams() {
+    iterations = 4000;
+    time_budget = 2.0;
+    playout_turns = 4;
+    playout_actions = 12;
+    max_actions = 40;
+    max_nodes = 200000;
+    exploration = 1.4;
+    tt_min_depth = 8;
+    cancel = NULL;
+}
+
+MCTS::Tree::Tree(const BoardTopology *topo, int max_nodes, uint64_t seed,
+                 TranspositionTable *tt)
+    : m_board(topo), m_rng(seed) {
+    m_tt = tt;
+    m_playouts = 0;
+    m_tt_probes = 0;
+    m_tt_hits = 0;
+    m_nodes.reserve(max_nodes);
+    m_moves.resize(max_moves);
+}
+
+MCTS::MCTS(const BoardTopology *topo, const MCTSParams& params, uint64_t seed,
+           WorkerPool *pool, TranspositionTable *tt)
+    : m_params(params), m_root(topo) {
+    m_playouts = 0;
+    m_time = 0;
+    m_tt_probes = 0;
+    m_tt_hits = 0;
+    m_pool = pool;
+    m_tt = tt;
+
+    int threads = pool == NULL ? 1 : pool->size();
+    for(int i = 0; i < threads; i++) {
+        m_trees.push_back(new Tree(topo, m_params.max_nodes,
+                                   seed + i * 0x9e3779b97f4a7c15ULL, tt));
+    }
+}
+
+MCTS::~MCTS() {
+    for(auto&& t : m_trees) delete t;
+}
+
+int MCTS::Tree::select_child(int node, float exploration) {
+    const Node& parent = m_nodes[node];
+    const float log_visits = log((float)parent.m_visits + 1);
+
+    int best = -1;
+    float best_score = -1;
+
+    for(int i = 0; i < parent.m_num_children; i++) {
+        int c = parent.m_first_child + i;
+        const Node& child = m_nodes[c];
+        if(child.m_visits == 0)
+            return c;
+        float score = child.m_wins / child.m_visits
+            + exploration * sqrt(log_visits / child.m_visits);
+        if(score > best_score) {
+            best_score = score;
+            best = c;
+        }
+    }
+    return best;
+}
+
+// adds all the moves from m_board as children of node, if there's room
+void MCTS::Tree::expand(int node, int max_nodes) {
+    int n = m_board.gen_moves(m_moves.data(), max_moves);
+    if((int)m_nodes.size() + n > max_nodes)
+        return;
+
+    const Side mover = m_board.m_turn;
+    m_nodes[node].m_first_child = m_nodes.size();
+    m_nodes[node].m_num_children = n;
+
+    for(int i = 0; i < n; i++) {
+        Node child;
+        child.m_move = m_moves[i];
+        child.m_parent = node;
+        child.m_first_child = -1;
+        child.m_num_children = 0;
+        child.m_visits = 0;
+        child.m_wins = 0;
+        child.m_mover = mover;
+        m_nodes.push_back(child);
+    }
+
+    // try the best move from an earlier search of this position first.
+    // The root keeps gen_moves() order since the threads' roots are
+    // merged by index
+    TTEntry e;
+    if(node == 0 or m_tt == NULL or m_tt->probe(m_board.hash(), e) == false or
+       e.m_has_best == false)
+        return;
+
+    const int first = m_nodes[node].m_first_child;
+    for(int i = first; i < first + n; i++) {
+        const Move& m = m_nodes[i].m_move;
+        if(m.m_act == e.m_best.m_act and m.m_src == e.m_best.m_src and
+           m.m_dst == e.m_best.m_dst and m.m_amount == e.m_best.m_amount) {
+            swap(m_nodes[first].m_move, m_nodes[i].m_move);
+            break;
+        }
+    }
+}
+
+static inline bool aggressive(const Board& b, const Move& m) {
+    if(m.m_act == MapAction::FireCannon)
+        return true;
+    return m.m_act == MapAction::MovingUnits &&
+        b.m_cells[m.m_dst].side != (uint8_t)b.m_turn;
+}
+
+// plays m_board forward with random moves that prefer taking hexes, then
+// scores it. Returns the value for Red in [0, 1]
+float MCTS::Tree::playout(const MCTSParams& params) {
+    int turns = 0;
+    int actions = 0;
+
+    while(turns < params.playout_turns) {
+        if(m_board.winner() != Side::Neutral)
+            break;
+
+        int n = m_board.gen_moves(m_moves.data(), max_moves);
+        // m_moves[0] is always EndTurn
+        const Move *m = &m_moves[0];
+        if(n > 1 && actions < params.playout_actions && m_rng.unit() > 0.2f) {
+            m = &m_moves[1 + m_rng.below(n - 1)];
+            if(aggressive(m_board, *m) == false) {
+                m = &m_moves[1 + m_rng.below(n - 1)];
+            }
+        }
+
+        if(m->m_act == MapAction::EndTurn) {
+            turns++;
+            actions = 0;
+        } else {
+            actions++;
+        }
+        m_board.apply(*m);
+    }
+
+    Side w = m_board.winner();
+    if(w == Side::Red) return 1;
+    if(w == Side::Blue) return 0;
+    return 0.5 + 0.5 * tanh(m_board.material(Side::Red) / 50.0);
+}
+
+// value for Red of m_board: from the transposition table if it has a
+// good enough estimate, otherwise from a new playout that's added to it
+float MCTS::Tree::evaluate(const MCTSParams& params) {
+    if(m_tt == NULL) {
+        m_playouts++;
+        return playout(params);
+    }
+
+    const uint64_t key = m_board.hash();
+    TTEntry e;
+    bool found = m_tt->probe(key, e);
+    m_tt_probes++;
+    if(found == true) {
+        m_tt_hits++;
+        if(e.m_depth >= params.tt_min_depth)
+            return e.m_value;
+    } else {
+        e.m_value = 0;
+        e.m_depth = 0;
+        e.m_has_best = false;
+    }
+
+    const float value = playout(params);
+    m_playouts++;
+
+    e.m_value = (e.m_value * e.m_depth + value) / (e.m_depth + 1);
+    e.m_depth++;
+    m_tt->store(key, e);
+    return value;
+}
+
+void MCTS::Tree::backpropagate(int node, float red_value) {
+    for(int n = node; n != -1; n = m_nodes[n].m_parent) {
+        Node& cur = m_nodes[n];
+        cur.m_visits++;
+        cur.m_wins += cur.m_mover == Side::Red ? red_value : 1 - red_value;
+    }
+}
+
+// grows a new tree from root
+void MCTS::Tree::search(const Board& root, const MCTSParams& params, double deadline) {
+    m_nodes.clear();
+
+    Node r;
+    r.m_move = { MapAction::EndTurn, -1, -1, 0 };
+    r.m_parent = -1;
+    r.m_first_child = -1;
+    r.m_num_children = 0;
+    r.m_visits = 0;
+    r.m_wins = 0;
+    r.m_mover = root.other_side();
+    m_nodes.push_back(r);
+
+    for(int it = 0; it < params.iterations; it++) {
+        if((it & 63) == 0 && it > 0 && deadline > 0 && now() > deadline)
+            break;
+        if((it & 63) == 0 && params.cancelled())
+            break;
+
+        m_board.copy_from(root);
+
+        // selection
+        int node = 0;
+        while(m_nodes[node].m_num_children > 0) {
+            node = select_child(node, params.exploration);
+            m_board.apply(m_nodes[node].m_move);
+        }
+
+        // expansion
+        if(m_board.winner() == Side::Neutral &&
+           (node == 0 || m_nodes[node].m_visits > 0)) {
+            expand(node, params.max_nodes);
+            if(m_nodes[node].m_num_children > 0) {
+                node = m_nodes[node].m_first_child +
+                    m_rng.below(m_nodes[node].m_num_children);
+                m_board.apply(m_nodes[node].m_move);
+            }
+        }
+
+        backpropagate(node, evaluate(params));
+    }
+
+    if(m_tt == NULL or m_nodes[0].m_num_children == 0)
+        return;
+
+    // remember the most visited move from the root
+    const Node& root_node = m_nodes[0];
+    int best = root_node.m_first_child;
+    for(int i = 1; i < root_node.m_num_children; i++) {
+        int c = root_node.m_first_child + i;
+        if(m_nodes[c].m_visits > m_nodes[best].m_visits)
+            best = c;
+    }
+
+    TTEntry e;
+    float mover_value = root_node.m_wins / max(root_node.m_visits, 1);
+    e.m_value = root_node.m_mover == Side::Red ? mover_value : 1 - mover_value;
+    e.m_depth = root_node.m_visits;
+    e.m_has_best = true;
+    e.m_best = m_nodes[best].m_move;
+    m_tt->store(root.hash(), e);
+}
+
+// best move for the side to move on m_root
+Move MCTS::search(double deadline) {
+    if(m_trees.size() == 1) {
+        m_trees[0]->search(m_root, m_params, deadline);
+    } else {
+        m_pool->run(m_trees.size(), [&](int i) {
+                m_trees[i]->search(m_root, m_params, deadline);
+            });
+    }
+
+    // every tree expanded the root from the same position, so the
+    // children are the same moves in the same order
+    const Tree *first = m_trees.front();
+    const Node& r = first->m_nodes[0];
+    int best = -1;
+    long best_visits = -1;
+
+    for(int i = 0; i < r.m_num_children; i++) {
+        long visits = 0;
+        for(auto&& t : m_trees) {
+            const Node& tr = t->m_nodes[0];
+            if(tr.m_num_children == r.m_num_children)
+                visits += t->m_nodes[tr.m_first_child + i].m_visits;
+        }
+        if(visits > best_visits) {
+            best_visits = visits;
+            best = i;
+        }
+    }
+
+    if(best == -1)
+        return r.m_move;
+    return first->m_nodes[r.m_first_child + best].m_move;
+}
+
+void MCTS::play_turn(const Board& b, vector<Move>& out) {
+    const double start = now();
+    const double turn_deadline = start + m_params.time_budget;
+
+    m_root.copy_from(b);
+    for(auto&& t : m_trees) {
+        t->m_playouts = 0;
+        t->m_tt_probes = 0;
+        t->m_tt_hits = 0;
+    }
+    if(m_tt != NULL)
+        m_tt->new_search();
+    out.clear();
+
+    for(int a = 0; a < m_params.max_actions && m_params.cancelled() == false; a++) {
+        // spend at most a third of what's left on each action
+        double t = now();
+        Move best = search(m_params.time_budget > 0 ? t + (turn_deadline - t) / 3 : 0);
+
+        if(best.m_act == MapAction::EndTurn || m_root.is_legal(best) == false)
+            break;
+
+        m_root.apply(best);
+        out.push_back(best);
+
+        if(m_root.winner() != Side::Neutral)
+            break;
+    }
+
+    m_playouts = 0;
+    m_tt_probes = 0;
+    m_tt_hits = 0;
+    for(auto&& t : m_trees) {
+        m_playouts += t->m_playouts;
+        m_tt_probes += t->m_tt_probes;
+        m_tt_hits += t->m_tt_hits;
+    }
+    m_time = now() - start;
+}
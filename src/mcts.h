@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "./board.h"
+#include "./rng.h"
+
+struct WorkerPool;
+struct TranspositionTable;
+
+struct MCTSParams {
+    // search stops at whichever runs out first
+    int iterations;      // per action and thread
+    // seconds per turn, or <= 0 to only stop on iterations, which
+    // makes the search repeatable for a seed
+    double time_budget;
+    // turns simulated by a playout before the position is scored
+    int playout_turns;
+    // actions a playout makes in one turn before ending it
+    int playout_actions;
+    // most actions the AI makes in a turn
+    int max_actions;
+    int max_nodes;       // per thread
+    float exploration;
+    // a transposition table entry averaged over at least this many
+    // playouts is used instead of a new playout
+    int tt_min_depth;
+    // stops the search as soon as it's set, keeping the moves found
+    // so far. NULL to never stop early
+    const std::atomic<bool> *cancel;
+
+    MCTSParams();
+
+    bool cancelled(void) const {
+        return cancel != NULL && cancel->load(std::memory_order_relaxed);
+    }
+};
+
+/*
+  Monte Carlo tree search over Board moves. Ending the turn is a move
+  too, so the tree continues into the other side's reply.
+
+  With a WorkerPool the search is root parallel: every thread grows its
+  own tree from the same position and the visit counts of the root's
+  children are added up to pick the move.
+
+  With a TranspositionTable, playout results are shared between move
+  orders that reach the same position, between the threads and between
+  the searches for each action of the turn.
+ */
+struct MCTS {
+    MCTSParams m_params;
+
+    // statistics for the last play_turn()
+    long m_playouts;
+    double m_time;
+    long m_tt_probes;
+    long m_tt_hits;
+
+    MCTS(const BoardTopology *topo, const MCTSParams& params, uint64_t seed,
+         WorkerPool *pool = NULL, TranspositionTable *tt = NULL);
+    ~MCTS();
+
+    // plays the turn of the side to move on b. The moves are written to
+    // out, without the final EndTurn
+    void play_turn(const Board& b, std::vector<Move>& out);
+
+private:
+    struct Node {
+        Move m_move;
+        int m_parent;
+        int m_first_child;
+        int m_num_children;
+        int m_visits;
+        // wins of the side that made m_move
+        float m_wins;
+        Side m_mover;
+    };
+
+    // one search thread's tree and scratch
+    struct Tree {
+        std::vector<Node> m_nodes;
+        std::vector<Move> m_moves;
+        Board m_board;
+        Rng m_rng;
+        TranspositionTable *m_tt;
+        long m_playouts;
+        long m_tt_probes;
+        long m_tt_hits;
+
+        Tree(const BoardTopology *topo, int max_nodes, uint64_t seed,
+             TranspositionTable *tt);
+
+        void search(const Board& root, const MCTSParams& params, double deadline);
+        int select_child(int node, float exploration);
+        void expand(int node, int max_nodes);
+        float playout(const MCTSParams& params);
+        float evaluate(const MCTSParams& params);
+        void backpropagate(int node, float red_value);
+    };
+
+    WorkerPool *m_pool;
+    TranspositionTable *m_tt;
+    std::vector<Tree *> m_trees;
+    Board m_root;
+
+    Move search(double deadline);
+};
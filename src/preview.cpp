@@ -0,0 +1,128 @@
+#include "./preview.h"
+
+#include <cmath>
+#include <fstream>
+
+#include <sys/stat.h>
+
+#include <allegro5/allegro_image.h>
+
+#include "./hexbatch.h"
+#include "./side.h"
+#include "./util.h"
+
+using namespace std;
+
+void map_bounds(const vector<MapFileHex>& hexes, float& x1, float& y1, float& x2, float& y2) {
+    x1 = y1 = 0;
+    x2 = y2 = 0;
+    bool first = true;
+    for(auto&& h : hexes) {
+        const float a = 2 * h.m_r;
+        if(first == true or h.m_cx - a < x1) x1 = h.m_cx - a;
+        if(first == true or h.m_cy - a < y1) y1 = h.m_cy - a;
+        if(first == true or h.m_cx + a > x2) x2 = h.m_cx + a;
+        if(first == true or h.m_cy + a > y2) y2 = h.m_cy + a;
+        first = false;
+    }
+}
+
+void draw_map(const vector<MapFileHex>& hexes,
+              float x1, float y1, float x2, float y2, float w, float h) {
+    if(x2 <= x1 or y2 <= y1)
+        return;
+    const float scale = min(w / (x2 - x1), h / (y2 - y1));
+    // centered in the area
+    const float ox = (w - (x2 - x1) * scale) / 2;
+    const float oy = (h - (y2 - y1) * scale) / 2;
+
+    HexBatch batch;
+    for(auto&& hex : hexes) {
+        if(hex.m_cell.alive() == false)
+            continue;
+
+        // the same colors and gap as Hex::draw()
+        ALLEGRO_COLOR c;
+        if(hex.m_cell.side == (uint8_t)Side::Red) c = al_map_rgb_f(0.94, 0.5, 0.5);
+        else if(hex.m_cell.side == (uint8_t)Side::Blue) c = al_map_rgb_f(0.5, 0.5, 0.94);
+        else c = al_map_rgb_f(0.5, 0.5, 0.5);
+        const float space = 4;
+        const float a = hex.m_r * 2 / sqrt(3);
+
+        batch.add(ox + (hex.m_cx - x1) * scale, oy + (hex.m_cy - y1) * scale,
+                  scale * (a - space), c);
+    }
+    batch.draw();
+}
+
+ALLEGRO_BITMAP *render_map(const vector<MapFileHex>& hexes, int w, int h, const float *view) {
+    float x1, y1, x2, y2;
+    if(view != NULL) {
+        x1 = view[0];
+        y1 = view[1];
+        x2 = view[2];
+        y2 = view[3];
+    } else {
+        map_bounds(hexes, x1, y1, x2, y2);
+    }
+
+    const int old_flags = al_get_new_bitmap_flags();
+    al_set_new_bitmap_flags(ALLEGRO_MEMORY_BITMAP);
+    ALLEGRO_BITMAP *bitmap = al_create_bitmap(w, h);
+    al_set_new_bitmap_flags(old_flags);
+    if(bitmap == NULL)
+        return NULL;
+
+    ALLEGRO_STATE state;
+    al_store_state(&state, ALLEGRO_STATE_TARGET_BITMAP);
+    al_set_target_bitmap(bitmap);
+    al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+    draw_map(hexes, x1, y1, x2, y2, w, h);
+    al_restore_state(&state);
+    return bitmap;
+}
+
+// see map_preview_filename()
+static const int preview_version = 1;
+
+string map_preview_filename(const char *map_filename, int w, int h) {
+    string name = map_filename;
+    return name.substr(0, name.rfind(".map")) + "-v" + to_string(preview_version) +
+        "-" + to_string(w) + "x" + to_string(h) + ".png";
+}
+
+ALLEGRO_BITMAP *load_map_preview(const char *map_filename, int w, int h) {
+    const string filename = map_preview_filename(map_filename, w, h);
+
+    struct stat map_st, preview_st;
+    if(stat(map_filename, &map_st) != 0)
+        return NULL;
+    if(stat(filename.c_str(), &preview_st) == 0 and preview_st.st_mtime >= map_st.st_mtime) {
+        ALLEGRO_BITMAP *bitmap = al_load_bitmap(filename.c_str());
+        // the name says the size, but the file could be anything
+        if(bitmap != NULL and al_get_bitmap_width(bitmap) == w and
+           al_get_bitmap_height(bitmap) == h)
+            return bitmap;
+        if(bitmap != NULL)
+            al_destroy_bitmap(bitmap);
+    }
+
+    ifstream in(map_filename, ios::in);
+    vector<MapFileHex> hexes;
+    if(in.fail() == true or read_map_file(in, hexes) == false) {
+        info("load_map_preview(): couldn't read %s", map_filename);
+        return NULL;
+    }
+    ALLEGRO_BITMAP *rendered = render_map(hexes, w, h);
+    if(rendered == NULL)
+        return NULL;
+    if(al_save_bitmap(filename.c_str(), rendered) == true)
+        info("load_map_preview(): wrote %s", filename.c_str());
+    else
+        info("load_map_preview(): couldn't write %s", filename.c_str());
+
+    // in whatever kind of bitmap the caller makes
+    ALLEGRO_BITMAP *bitmap = al_clone_bitmap(rendered);
+    al_destroy_bitmap(rendered);
+    return bitmap;
+}
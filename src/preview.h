@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <allegro5/allegro.h>
+
+#include "./mapfile.h"
+
+// the world rectangle the hexes are in, like HexMap::bounds()
+void map_bounds(const std::vector<MapFileHex>& hexes,
+                float& x1, float& y1, float& x2, float& y2);
+
+// draws the live hexes in the world rectangle (x1, y1, x2, y2) to the
+// current target, scaled to fit a w by h area at its top left. The
+// hexes look like Hex::draw() with nothing selected
+void draw_map(const std::vector<MapFileHex>& hexes,
+              float x1, float y1, float x2, float y2, float w, float h);
+
+// a new memory bitmap of the hexes in the world rectangle, or of the
+// whole map if view is NULL. Doesn't need a display
+ALLEGRO_BITMAP *render_map(const std::vector<MapFileHex>& hexes, int w, int h,
+                           const float *view = NULL);
+
+// maps/China.map's w x h preview is maps/China-v1-400x300.png. The
+// version goes up when draw_map() draws differently, so older previews
+// aren't used
+std::string map_preview_filename(const char *map_filename, int w, int h);
+
+// the w x h preview next to map_filename, rendered and saved first if
+// it's missing, older than the map, or not w x h. NULL if the map
+// can't be read
+ALLEGRO_BITMAP *load_map_preview(const char *map_filename, int w, int h);
@@ -0,0 +1,137 @@
+/*
+  avarice-preview: draws maps and replays to image files, without a
+  window.
+
+    avarice-preview [-size w h] [-view x1 y1 x2 y2] [-o out.png] maps/China.map ...
+    avarice-preview [-size w h] [-view x1 y1 x2 y2] [-o out.png] -replay game.replay -turn n
+
+  Maps are drawn as they start, to maps/China-v1-400x300.png (see
+  map_preview_filename()) unless -o is given. At the default size that's
+  the preview the game setup shows, so running this over every map in
+  maps/ makes them all ahead of time. A replay is drawn as it was
+  at the start of -turn, to game-<n>.png. -view draws that world
+  rectangle instead of the whole map, which with -o makes images to
+  compare against when the drawing changes.
+
+  Everything is drawn to memory bitmaps, so it doesn't need a display.
+ */
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <allegro5/allegro.h>
+#include <allegro5/allegro_image.h>
+#include <allegro5/allegro_primitives.h>
+
+#include "./board.h"
+#include "./config.h"
+#include "./mapfile.h"
+#include "./preview.h"
+#include "./replay.h"
+#include "./util.h"
+
+using namespace std;
+
+// for util.cpp
+Config cfg;
+bool debug_output = false;
+
+static bool read_map(const char *filename, vector<MapFileHex>& hexes) {
+    ifstream in(filename, ios::in);
+    if(in.fail() == true or read_map_file(in, hexes) == false) {
+        info("Couldn't read %s", filename);
+        return false;
+    }
+    return true;
+}
+
+static void save(const vector<MapFileHex>& hexes, int w, int h, const float *view,
+                 const string& out) {
+    ALLEGRO_BITMAP *bitmap = render_map(hexes, w, h, view);
+    if(bitmap == NULL)
+        fatal_error("Couldn't create a %dx%d bitmap", w, h);
+    if(al_save_bitmap(out.c_str(), bitmap) == false)
+        fatal_error("Couldn't write %s", out.c_str());
+    al_destroy_bitmap(bitmap);
+    info("Wrote %s", out.c_str());
+}
+
+// the replay's map as it was at the start of turn
+static bool read_replay(const char *filename, int turn, vector<MapFileHex>& hexes) {
+    ReplayReader replay;
+    if(replay.open(filename) == false) {
+        info("Couldn't read %s", filename);
+        return false;
+    }
+    const string map_filename = "maps/" + replay.map_name();
+    if(read_map(map_filename.c_str(), hexes) == false)
+        return false;
+
+    BoardTopology topo;
+    build_topology(hexes, cannon_min_range, cannon_max_range, topo);
+    Board b(&topo);
+    if(replay.seek(turn, b) == false) {
+        info("%s doesn't have turn %d", filename, turn);
+        return false;
+    }
+    for(int i = 0; i < (int)hexes.size(); i++) {
+        hexes[i].m_cell = b.m_cells[i];
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    int w = 400;
+    int h = 300;
+    float view[4];
+    bool have_view = false;
+    const char *out = NULL;
+    const char *replay = NULL;
+    int turn = 0;
+    vector<const char *> maps;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-size") == 0 and i + 2 < argc) {
+            w = atoi(argv[++i]);
+            h = atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "-view") == 0 and i + 4 < argc) {
+            for(int k = 0; k < 4; k++) view[k] = atof(argv[++i]);
+            have_view = true;
+        }
+        else if(strcmp(argv[i], "-o") == 0 and i + 1 < argc) out = argv[++i];
+        else if(strcmp(argv[i], "-replay") == 0 and i + 1 < argc) replay = argv[++i];
+        else if(strcmp(argv[i], "-turn") == 0 and i + 1 < argc) turn = atoi(argv[++i]);
+        else maps.push_back(argv[i]);
+    }
+    if((maps.empty() == true and replay == NULL) or w <= 0 or h <= 0) {
+        info("usage: %s [-size w h] [-view x1 y1 x2 y2] [-o out.png] maps/China.map ...", argv[0]);
+        info("       %s [-size w h] [-view x1 y1 x2 y2] [-o out.png] -replay game.replay -turn n", argv[0]);
+        return 1;
+    }
+
+    if(al_init() == false or al_init_primitives_addon() == false or
+       al_init_image_addon() == false)
+        fatal_error("Couldn't initialize allegro");
+
+    const float *v = have_view == true ? view : NULL;
+    vector<MapFileHex> hexes;
+
+    if(replay != NULL) {
+        if(read_replay(replay, turn, hexes) == false)
+            return 1;
+        string name = replay;
+        name = name.substr(0, name.rfind(".replay")) + "-" + to_string(turn) + ".png";
+        save(hexes, w, h, v, out != NULL ? out : name);
+    }
+
+    for(auto&& m : maps) {
+        if(read_map(m, hexes) == false)
+            continue;
+        // -o with several maps would only keep the last one
+        save(hexes, w, h, v, out != NULL and maps.size() == 1 ? out : map_preview_filename(m, w, h));
+    }
+    return 0;
+}
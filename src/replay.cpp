@@ -0,0 +1,220 @@
+#include "./replay.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "./util.h"
+#include "./varint.h"
+
+using namespace std;
+
+static const char magic[4] = { 'A', 'V', 'R', 'P' };
+static const int version = 1;
+
+ReplayWriter::ReplayWriter() {
+    m_keyframe_interval = 10;
+    m_turn = 0;
+    m_side = Side::Neutral;
+}
+
+ReplayWriter::~ReplayWriter() {
+    close();
+}
+
+bool ReplayWriter::open(const char *filename, const char *map_name, uint64_t seed,
+                        int hexes, int keyframe_interval) {
+    m_out.open(filename, ios::out | ios::binary | ios::trunc);
+    if(m_out.fail() == true) {
+        info("ReplayWriter::open(): couldn't open %s", filename);
+        return false;
+    }
+    m_keyframe_interval = max(keyframe_interval, 1);
+    m_moves.clear();
+
+    vector<uint8_t> header(magic, magic + 4);
+    put_uint(header, version);
+    put_uint(header, strlen(map_name));
+    header.insert(header.end(), map_name, map_name + strlen(map_name));
+    put_uint(header, seed);
+    put_uint(header, hexes);
+    put_uint(header, m_keyframe_interval);
+    m_out.write((const char *)header.data(), header.size());
+    return true;
+}
+
+void ReplayWriter::close(void) {
+    if(m_out.is_open() == false)
+        return;
+    // a game that was left in the middle of a turn
+    if(m_moves.empty() == false)
+        write_turn(m_turn, m_side, false);
+    m_out.close();
+}
+
+void ReplayWriter::write_record(uint8_t tag, const vector<uint8_t>& payload) {
+    vector<uint8_t> head;
+    head.push_back(tag);
+    put_uint(head, payload.size());
+    m_out.write((const char *)head.data(), head.size());
+    m_out.write((const char *)payload.data(), payload.size());
+}
+
+void ReplayWriter::keyframe(int turn, const Board& b) {
+    if(m_out.is_open() == false)
+        return;
+
+    vector<uint8_t> p;
+    p.reserve(16 + b.size() * 6);
+    put_uint(p, turn);
+    p.push_back((uint8_t)b.m_turn);
+    for(int s = 0; s < 2; s++) {
+        put_int(p, b.m_resources[s]);
+        put_int(p, b.m_carriers[s]);
+    }
+    for(auto&& c : b.m_cells) {
+        put_int(p, c.level);
+        put_int(p, c.units_free);
+        put_int(p, c.units_moved);
+        p.push_back(c.side);
+        p.push_back(c.flags);
+    }
+    write_record('K', p);
+}
+
+void ReplayWriter::move(const Move& m) {
+    m_moves.push_back(m);
+}
+
+void ReplayWriter::undo(void) {
+    if(m_moves.empty() == false)
+        m_moves.pop_back();
+}
+
+void ReplayWriter::end_turn(int turn, Side side) {
+    m_turn = turn;
+    m_side = side;
+    if(m_out.is_open() == false)
+        return;
+    write_turn(turn, side, true);
+    m_turn = turn + 1;
+}
+
+void ReplayWriter::write_turn(int turn, Side side, bool ended) {
+    vector<uint8_t> p;
+    put_uint(p, turn);
+    p.push_back((uint8_t)side);
+    p.push_back(ended ? 1 : 0);
+    for(auto&& m : m_moves) put_move(p, m);
+    write_record('T', p);
+    m_moves.clear();
+    m_out.flush();
+}
+
+bool ReplayReader::open(const char *filename) {
+    ifstream in(filename, ios::in | ios::binary);
+    if(in.fail() == true)
+        return false;
+    m_data.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    m_turns.clear();
+    m_keyframes.clear();
+
+    if(m_data.size() < 4 or memcmp(m_data.data(), magic, 4) != 0) {
+        info("ReplayReader::open(): %s isn't a replay", filename);
+        return false;
+    }
+
+    Cursor c = { m_data.data(), 4, m_data.size(), true };
+    if((int)c.get_uint() != version) {
+        info("ReplayReader::open(): %s has an unknown version", filename);
+        return false;
+    }
+    size_t len = c.get_uint();
+    if(c.ok == false or c.pos + len > c.end)
+        return false;
+    m_map_name.assign((const char *)m_data.data() + c.pos, len);
+    c.pos += len;
+    m_seed = c.get_uint();
+    m_hexes = c.get_uint();
+    c.get_uint(); // keyframe interval
+
+    // only the record boundaries are read here
+    while(c.ok == true and c.pos < c.end) {
+        uint8_t tag = c.get_byte();
+        size_t size = c.get_uint();
+        if(c.ok == false or c.pos + size > c.end)
+            break;
+        Cursor r = { m_data.data(), c.pos, c.pos + size, true };
+        int turn = r.get_uint();
+
+        if(tag == 'K') {
+            m_keyframes.push_back(make_pair(turn, c.pos));
+        }
+        else if(tag == 'T') {
+            if(turn != (int)m_turns.size()) {
+                info("ReplayReader::open(): turn %d out of order", turn);
+                return false;
+            }
+            TurnRecord t;
+            t.m_side = (Side)r.get_byte();
+            t.m_ended = r.get_byte() != 0;
+            t.m_offset = r.pos;
+            t.m_end = r.end;
+            m_turns.push_back(t);
+        }
+        c.pos += size;
+    }
+
+    debug("ReplayReader::open(): %s on %s, %d turns, %d keyframes", filename,
+          m_map_name.c_str(), m_turns.size(), m_keyframes.size());
+    return c.ok;
+}
+
+bool ReplayReader::turn_moves(int turn, vector<Move>& out) const {
+    out.clear();
+    if(turn < 0 or turn >= (int)m_turns.size())
+        return false;
+
+    const TurnRecord& t = m_turns[turn];
+    Cursor c = { m_data.data(), t.m_offset, t.m_end, true };
+    while(c.ok == true and c.pos < c.end) {
+        out.push_back(get_move(c));
+    }
+    return c.ok;
+}
+
+bool ReplayReader::seek(int turn, Board& b) const {
+    if(b.size() != m_hexes or turn < 0)
+        return false;
+
+    // the last keyframe at or before turn
+    auto it = upper_bound(m_keyframes.begin(), m_keyframes.end(), make_pair(turn, (size_t)-1));
+    if(it == m_keyframes.begin())
+        return false;
+    --it;
+
+    Cursor c = { m_data.data(), it->second, m_data.size(), true };
+    int from = c.get_uint();
+    b.m_turn = (Side)c.get_byte();
+    for(int s = 0; s < 2; s++) {
+        b.m_resources[s] = c.get_int();
+        b.m_carriers[s] = c.get_int();
+    }
+    for(auto&& cell : b.m_cells) {
+        cell.level = c.get_int();
+        cell.units_free = c.get_int();
+        cell.units_moved = c.get_int();
+        cell.side = c.get_byte();
+        cell.flags = c.get_byte();
+    }
+    if(c.ok == false)
+        return false;
+
+    vector<Move> moves;
+    for(int t = from; t < turn; t++) {
+        if(turn_moves(t, moves) == false or m_turns[t].m_ended == false)
+            return false;
+        for(auto&& m : moves) b.apply(m);
+        b.apply({ MapAction::EndTurn, -1, -1, 0 });
+    }
+    return true;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "./board.h"
+
+/*
+  Replay files record a game as the map file it was played on, the
+  game seed and the moves of every turn, with hexes by index. Every
+  keyframe interval turns the whole Board is stored as well, so a
+  viewer can seek to a turn by playing from the keyframe before it
+  instead of from the start.
+
+  Numbers are LEB128 varints, signed ones zigzag encoded.
+
+    header   "AVRP" version map-name seed hexes keyframe-interval
+    records  tag length payload
+      'K'    turn, the Board at the start of the turn
+      'T'    turn side ended moves..., one turn's moves. ended is 0
+             for the last turn of a game that was left unfinished
+ */
+struct ReplayWriter {
+    ReplayWriter();
+    ~ReplayWriter();
+
+    bool open(const char *filename, const char *map_name, uint64_t seed,
+              int hexes, int keyframe_interval = 10);
+    void close(void);
+
+    bool want_keyframe(int turn) const {
+        return m_out.is_open() and turn % m_keyframe_interval == 0;
+    }
+    void keyframe(int turn, const Board& b);
+
+    // the current turn's moves are kept until the turn ends, so they
+    // can be undone
+    void move(const Move& m);
+    void undo(void);
+    void end_turn(int turn, Side side);
+
+private:
+    std::ofstream m_out;
+    int m_keyframe_interval;
+    std::vector<Move> m_moves;
+    int m_turn;
+    Side m_side;
+
+    void write_turn(int turn, Side side, bool ended);
+    void write_record(uint8_t tag, const std::vector<uint8_t>& payload);
+};
+
+struct ReplayReader {
+    bool open(const char *filename);
+
+    const std::string& map_name(void) const { return m_map_name; }
+    uint64_t seed(void) const { return m_seed; }
+    int hexes(void) const { return m_hexes; }
+    int num_turns(void) const { return m_turns.size(); }
+
+    // sets b, which has to be on the replay's map, to the state at the
+    // start of turn. Only the turns since the keyframe before it are
+    // played
+    bool seek(int turn, Board& b) const;
+    // turn's moves, not counting the end of the turn
+    bool turn_moves(int turn, std::vector<Move>& out) const;
+
+private:
+    std::vector<uint8_t> m_data;
+    std::string m_map_name;
+    uint64_t m_seed;
+    int m_hexes;
+
+    struct TurnRecord {
+        size_t m_offset;
+        size_t m_end;
+        Side m_side;
+        bool m_ended;
+    };
+    std::vector<TurnRecord> m_turns;
+    // (turn, offset) of each keyframe, by turn
+    std::vector<std::pair<int, size_t>> m_keyframes;
+};
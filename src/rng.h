@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+
+// xoshiro256** seeded with splitmix64
+struct Rng {
+    uint64_t m_s[4];
+
+    explicit Rng(uint64_t seed = 0x853c49e6748fea9bULL) {
+        this->seed(seed);
+    }
+
+    void seed(uint64_t seed) {
+        for(int i = 0; i < 4; i++) {
+            seed += 0x9e3779b97f4a7c15ULL;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            m_s[i] = z ^ (z >> 31);
+        }
+    }
+
+    static inline uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    uint64_t next(void) {
+        const uint64_t result = rotl(m_s[1] * 5, 7) * 9;
+        const uint64_t t = m_s[1] << 17;
+        m_s[2] ^= m_s[0];
+        m_s[3] ^= m_s[1];
+        m_s[1] ^= m_s[2];
+        m_s[0] ^= m_s[3];
+        m_s[2] ^= t;
+        m_s[3] = rotl(m_s[3], 45);
+        return result;
+    }
+
+    // uniform in [0, n)
+    int below(int n) {
+        return (int)(((next() >> 32) * (uint64_t)n) >> 32);
+    }
+
+    // uniform in [0, 1)
+    float unit(void) {
+        return (next() >> 40) * (1.0f / 16777216.0f);
+    }
+};
@@ -0,0 +1,9 @@
+#pragma once
+
+enum class Side {
+    Red,
+    Blue,
+    Green,
+    Yellow,
+    Neutral,
+};
@@ -1,14 +1,7 @@
 #pragma once
 
 #include "./button.h"
-
-enum class Side {
-    Red,
-    Blue,
-    Green,
-    Yellow,
-    Neutral,
-};
+#include "./side.h"
 
 struct SideButton : Button {
     bool m_outlined;
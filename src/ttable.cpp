@@ -0,0 +1,101 @@
+#include "./ttable.h"
+
+#include <algorithm>
+
+using namespace std;
+
+/*
+  m_data layout:
+   0-15  value * 65535
+  16-31  depth
+  32-47  generation
+  48     has best move
+ */
+static inline uint64_t pack_data(const TTEntry& e, unsigned generation) {
+    uint64_t value = (uint64_t)(min(max(e.m_value, 0.0f), 1.0f) * 65535.0f + 0.5f);
+    uint64_t depth = (uint64_t)min(max(e.m_depth, 0), 65535);
+    return value
+        | (depth << 16)
+        | ((uint64_t)(generation & 0xffff) << 32)
+        | ((uint64_t)(e.m_has_best ? 1 : 0) << 48);
+}
+
+static inline uint64_t pack_move(const Move& m) {
+    return (uint64_t)(uint8_t)m.m_act
+        | ((uint64_t)(uint16_t)(m.m_src + 1) << 8)
+        | ((uint64_t)(uint16_t)(m.m_dst + 1) << 24)
+        | ((uint64_t)(uint16_t)m.m_amount << 40);
+}
+
+static inline Move unpack_move(uint64_t v) {
+    Move m;
+    m.m_act = (MapAction)(v & 0xff);
+    m.m_src = (int)((v >> 8) & 0xffff) - 1;
+    m.m_dst = (int)((v >> 24) & 0xffff) - 1;
+    m.m_amount = (int)((v >> 40) & 0xffff);
+    return m;
+}
+
+TranspositionTable::TranspositionTable(int log2_size)
+    : m_slots((size_t)1 << log2_size) {
+    m_mask = m_slots.size() - 1;
+    m_generation = 0;
+    clear();
+}
+
+void TranspositionTable::clear(void) {
+    for(auto&& s : m_slots) {
+        s.m_check.store(0, memory_order_relaxed);
+        s.m_data.store(0, memory_order_relaxed);
+        s.m_move.store(0, memory_order_relaxed);
+    }
+}
+
+void TranspositionTable::new_search(void) {
+    m_generation++;
+}
+
+bool TranspositionTable::probe(uint64_t key, TTEntry& out) const {
+    const Slot& s = m_slots[key & m_mask];
+    const uint64_t data = s.m_data.load(memory_order_relaxed);
+    const uint64_t move = s.m_move.load(memory_order_relaxed);
+    const uint64_t check = s.m_check.load(memory_order_relaxed);
+
+    if((check ^ data ^ move) != key or data == 0)
+        return false;
+
+    // only this search's results, so that a search gives the same
+    // moves whatever was searched before it
+    const unsigned generation = m_generation.load(memory_order_relaxed);
+    if(((data >> 32) & 0xffff) != (generation & 0xffff))
+        return false;
+
+    out.m_value = (data & 0xffff) / 65535.0f;
+    out.m_depth = (data >> 16) & 0xffff;
+    out.m_has_best = ((data >> 48) & 1) != 0;
+    out.m_best = unpack_move(move);
+    return true;
+}
+
+void TranspositionTable::store(uint64_t key, const TTEntry& e) {
+    Slot& s = m_slots[key & m_mask];
+    const unsigned generation = m_generation.load(memory_order_relaxed);
+
+    const uint64_t old_data = s.m_data.load(memory_order_relaxed);
+    const uint64_t old_move = s.m_move.load(memory_order_relaxed);
+    const uint64_t old_key = s.m_check.load(memory_order_relaxed) ^ old_data ^ old_move;
+    const int old_depth = (old_data >> 16) & 0xffff;
+    const unsigned old_generation = (old_data >> 32) & 0xffff;
+
+    // replace by depth, but always replace other positions from
+    // older searches
+    if(old_data != 0 and old_key != key and
+       old_generation == (generation & 0xffff) and old_depth > e.m_depth)
+        return;
+
+    const uint64_t data = pack_data(e, generation);
+    const uint64_t move = e.m_has_best ? pack_move(e.m_best) : 0;
+    s.m_data.store(data, memory_order_relaxed);
+    s.m_move.store(move, memory_order_relaxed);
+    s.m_check.store(key ^ data ^ move, memory_order_relaxed);
+}
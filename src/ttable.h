@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "./board.h"
+
+struct TTEntry {
+    // average playout value for Red from this position, in [0, 1]
+    float m_value;
+    // number of playouts m_value is averaged over
+    int m_depth;
+    bool m_has_best;
+    Move m_best;
+};
+
+/*
+  Fixed size table of search results keyed by Board::hash(), shared by
+  all the search threads without locking. A slot holds one position and
+  is replaced by a deeper result or by any result from a newer search.
+  Only results from the current search are returned by probe().
+
+  Each slot is stored as three words with the key xored with the other
+  two, so a slot torn by two threads writing at once reads as a miss.
+ */
+struct TranspositionTable {
+    // the table has 1 << log2_size slots
+    explicit TranspositionTable(int log2_size);
+
+    void clear(void);
+    // makes the entries from earlier searches replaceable and hides
+    // them from probe()
+    void new_search(void);
+
+    bool probe(uint64_t key, TTEntry& out) const;
+    void store(uint64_t key, const TTEntry& e);
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> m_check;
+        std::atomic<uint64_t> m_data;
+        std::atomic<uint64_t> m_move;
+    };
+
+    std::vector<Slot> m_slots;
+    uint64_t m_mask;
+    std::atomic<unsigned> m_generation;
+};
@@ -1,5 +1,6 @@
 #include "./ui.h"
 
+#include <algorithm>
 #include <cmath>
 
 #include "util.h"
@@ -58,26 +59,27 @@ bool UI::is_hit(Widget *widget) {
     return hit;
 }
 
+Widget *UI::hit_widget(void) {
+    for(auto& widget : widgets) {
+        if(widget->m_visible == true and is_hit(widget) == true)
+            return widget;
+    }
+    return NULL;
+}
+
 void UI::mouseDownEvent(void) {
     if(mouse_button == 1) {
-        for(auto& widget : widgets) {
-            if(widget->m_visible == false)
-                continue;
-
-            bool hit = is_hit(widget);
-
-            if(hit == true) {
-                debug("UI::mouseDownEvent(): hit!");
-                widget->mouseDownEvent();
-                if(widget->onMouseDown != nullptr) {
-                    widget->onMouseDown();
-                }
-                if(widget->m_type == WidgetType::Hex) {
-                    dispatch_hex_click(widget);
-                }
-                set_redraw();
-                return;
+        Widget *widget = hit_widget();
+        if(widget != NULL) {
+            debug("UI::mouseDownEvent(): hit!");
+            widget->mouseDownEvent();
+            if(widget->onMouseDown != nullptr) {
+                widget->onMouseDown();
             }
+            if(widget->m_type == WidgetType::Hex) {
+                dispatch_hex_click(widget);
+            }
+            set_redraw();
         }
     }
 }
@@ -90,10 +92,18 @@ void UI::keyDownEvent(void) {
     }
 }
 
+void UI::animate(Widget *w) {
+    if(std::find(m_animating.begin(), m_animating.end(), w) == m_animating.end())
+        m_animating.push_back(w);
+}
+
 void UI::update(void) {
-    for(auto& widget : widgets) {
+    for(auto& widget : m_animating) {
         widget->update();
     }
+    m_animating.erase(std::remove_if(m_animating.begin(), m_animating.end(),
+                                     [](Widget *w) { return w->animating() == false; }),
+                      m_animating.end());
 }
 
 void UI::draw(void) {
@@ -11,6 +11,8 @@ void register_global_key_callback(bool (*cb)(void));
 
 struct UI {
     std::vector<Widget *> widgets;
+    // the widgets update() calls, until they stop animating
+    std::vector<Widget *> m_animating;
 
     ALLEGRO_COLOR clear_to;
 
@@ -18,11 +20,15 @@ struct UI {
     virtual ~UI() { }
 
     bool is_hit(Widget *w);
+    // the visible widget under the mouse, or NULL
+    virtual Widget *hit_widget(void);
     virtual void mouseDownEvent(void);
     virtual void mouseUpEvent(void) {}
     virtual void keyDownEvent(void);
     virtual void hoverOverEvent(void) {}
 
+    // has update() call w->update() every tick while w->animating()
+    void animate(Widget *w);
     virtual void update(void);
     virtual void draw(void);
 
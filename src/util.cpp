@@ -4,6 +4,7 @@
 #include <cstdlib>
 #include <ctime>
 #include <cstdarg>
+#include <mutex>
 
 using namespace std;
 
@@ -11,6 +12,8 @@ using namespace std;
 #include "./config.h"
 
 static fstream logstream;
+// the AI can log from worker threads
+static mutex log_mutex;
 extern Config cfg;
 
 void init_logging(void) {
@@ -53,6 +56,8 @@ static inline void log(enum MESSAGE_LEVEL msgl, const char *format_string, va_li
         default: { } break;
         }
 
+    lock_guard<mutex> lock(log_mutex);
+
     cout << prefix << str << endl;
 
     if(logstream.is_open() == true) {
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "./board.h"
+
+// LEB128 varints, signed ones zigzag encoded, for the replay and book
+// files
+
+static inline void put_uint(std::vector<uint8_t>& out, uint64_t v) {
+    while(v >= 0x80) {
+        out.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+
+static inline void put_int(std::vector<uint8_t>& out, int64_t v) {
+    put_uint(out, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+// reads from data[pos, end), sets ok to false if it runs out
+struct Cursor {
+    const uint8_t *data;
+    size_t pos;
+    size_t end;
+    bool ok;
+
+    uint64_t get_uint(void) {
+        uint64_t v = 0;
+        for(int shift = 0; shift < 64; shift += 7) {
+            if(pos >= end) {
+                ok = false;
+                return 0;
+            }
+            uint8_t b = data[pos++];
+            v |= (uint64_t)(b & 0x7f) << shift;
+            if((b & 0x80) == 0)
+                return v;
+        }
+        ok = false;
+        return 0;
+    }
+    int64_t get_int(void) {
+        uint64_t v = get_uint();
+        return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+    }
+    uint8_t get_byte(void) {
+        if(pos >= end) {
+            ok = false;
+            return 0;
+        }
+        return data[pos++];
+    }
+};
+
+static inline void put_move(std::vector<uint8_t>& out, const Move& m) {
+    out.push_back((uint8_t)m.m_act);
+    put_uint(out, m.m_src + 1);
+    put_uint(out, m.m_dst + 1);
+    put_uint(out, m.m_amount);
+}
+
+static inline Move get_move(Cursor& c) {
+    Move m;
+    m.m_act = (MapAction)c.get_byte();
+    m.m_src = (int)c.get_uint() - 1;
+    m.m_dst = (int)c.get_uint() - 1;
+    m.m_amount = (int)c.get_uint();
+    return m;
+}
@@ -35,6 +35,9 @@ struct Widget {
     void (*onKeyDown)(void);
 
     virtual void update() {};
+    // whether update() still has something to do, once the widget has
+    // been passed to UI::animate()
+    virtual bool animating(void) { return false; }
     virtual void draw() = 0;
 
     // void draw_bb(void) {
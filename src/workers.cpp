@@ -0,0 +1,85 @@
+#include "./workers.h"
+
+#include "./util.h"
+
+using namespace std;
+
+WorkerPool::WorkerPool(int threads) {
+    if(threads <= 0)
+        threads = thread::hardware_concurrency();
+    if(threads <= 0)
+        threads = 1;
+
+    m_quit = false;
+    m_job = 0;
+    m_fn = NULL;
+    m_tasks = 0;
+    m_next = 0;
+    m_finished = 0;
+
+    for(int i = 1; i < threads; i++) {
+        m_helpers.push_back(thread(&WorkerPool::helper, this));
+    }
+    info("Started %d worker threads", threads);
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_cv.notify_all();
+    for(auto&& t : m_helpers) t.join();
+}
+
+// takes task indices until there are none left
+void WorkerPool::work(void) {
+    for(;;) {
+        int i = m_next++;
+        if(i >= m_tasks)
+            return;
+        (*m_fn)(i);
+    }
+}
+
+void WorkerPool::helper(void) {
+    unsigned seen = 0;
+    for(;;) {
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_cv.wait(lock, [&]{ return m_quit or m_job != seen; });
+            if(m_quit == true)
+                return;
+            seen = m_job;
+        }
+
+        work();
+
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_finished++;
+        }
+        m_done_cv.notify_all();
+    }
+}
+
+void WorkerPool::run(int tasks, const function<void(int)>& fn) {
+    lock_guard<mutex> run_lock(m_run_mutex);
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_fn = &fn;
+        m_tasks = tasks;
+        m_next = 0;
+        m_finished = 0;
+        m_job++;
+    }
+    m_cv.notify_all();
+
+    work();
+
+    // every helper checks in once per job, even if there was nothing
+    // left for it to do
+    unique_lock<mutex> lock(m_mutex);
+    m_done_cv.wait(lock, [this]{ return m_finished == (int)m_helpers.size(); });
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+  Fixed set of threads for splitting CPU heavy work. run() hands out
+  task indices to the helper threads and the calling thread, and
+  returns once all tasks are done. Calls to run() from different
+  threads take turns.
+ */
+struct WorkerPool {
+    // threads <= 0 uses one thread per core
+    explicit WorkerPool(int threads);
+    ~WorkerPool();
+
+    // threads working on run(), including the caller
+    int size(void) const { return m_helpers.size() + 1; }
+
+    void run(int tasks, const std::function<void(int)>& fn);
+
+private:
+    std::vector<std::thread> m_helpers;
+    std::mutex m_run_mutex;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::condition_variable m_done_cv;
+    bool m_quit;
+    unsigned m_job;
+    const std::function<void(int)> *m_fn;
+    int m_tasks;
+    std::atomic<int> m_next;
+    // helpers done with the current job
+    int m_finished;
+
+    void helper(void);
+    void work(void);
+};